@@ -0,0 +1,128 @@
+#ifdef IPK25_ALLOC_STATS
+
+#include "alloc_stats.hpp"
+#include "message.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+/* Global counters, updated by the replaced operators */
+static std::atomic<uint64_t> total_allocs{0};
+static std::atomic<uint64_t> total_frees{0};
+static std::atomic<uint64_t> total_bytes{0};
+
+/* Per direction and message type statistics */
+struct MsgStats {
+	uint64_t messages;
+	uint64_t allocs;
+	uint64_t bytes;
+};
+
+static MsgStats stats[2][256];
+
+/* Counter snapshot at the start of the current window */
+static uint64_t window_allocs = 0;
+static uint64_t window_bytes = 0;
+
+static void* counted_alloc(std::size_t size) {
+	total_allocs.fetch_add(1, std::memory_order_relaxed);
+	total_bytes.fetch_add(size, std::memory_order_relaxed);
+
+	return std::malloc(size ? size : 1);
+}
+
+static void counted_free(void* ptr) {
+	if (ptr != nullptr) {
+		total_frees.fetch_add(1, std::memory_order_relaxed);
+		std::free(ptr);
+	}
+}
+
+/**
+ *	Replaced global allocation functions
+ */
+void* operator new(std::size_t size) {
+	void* ptr = counted_alloc(size);
+
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { counted_free(ptr); }
+
+/**
+ *	Accounting
+ */
+void alloc_stats::mark() {
+	window_allocs = total_allocs.load(std::memory_order_relaxed);
+	window_bytes = total_bytes.load(std::memory_order_relaxed);
+}
+
+void alloc_stats::account(Direction direction, uint8_t msg_type) {
+	MsgStats& entry = stats[direction][msg_type];
+
+	entry.messages += 1;
+	entry.allocs += total_allocs.load(std::memory_order_relaxed) - window_allocs;
+	entry.bytes += total_bytes.load(std::memory_order_relaxed) - window_bytes;
+
+	mark();
+}
+
+int alloc_stats::report() {
+	const char* env = std::getenv("IPK25_ALLOC_BUDGET");
+	double budget = env != nullptr ? std::atof(env) : -1.0;
+	int over_budget = 0;
+
+	std::fprintf(stderr, "%-9s %-8s %10s %14s %14s\n", "Direction", "Type", "Messages", "Allocs/msg", "Bytes/msg");
+
+	for (int direction = INBOUND; direction <= OUTBOUND; ++direction) {
+		for (int type = 0; type < 256; ++type) {
+			const MsgStats& entry = stats[direction][type];
+
+			if (entry.messages == 0) {
+				continue;
+			}
+
+			double allocs = static_cast<double>(entry.allocs) / entry.messages;
+			double bytes = static_cast<double>(entry.bytes) / entry.messages;
+			bool over = budget >= 0 && allocs > budget;
+
+			std::fprintf(stderr, "%-9s %-8s %10llu %14.2f %14.2f%s\n",
+				direction == INBOUND ? "in" : "out", msg_type_name(type),
+				static_cast<unsigned long long>(entry.messages), allocs, bytes, over ? "  OVER BUDGET" : "");
+
+			over_budget |= over;
+		}
+	}
+
+	std::fprintf(stderr, "Total: %llu allocations, %llu frees, %llu bytes\n",
+		static_cast<unsigned long long>(total_allocs.load()),
+		static_cast<unsigned long long>(total_frees.load()),
+		static_cast<unsigned long long>(total_bytes.load()));
+
+	return over_budget;
+}
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file: alloc_stats.hpp
+ *
+ * Allocation accounting, compiled in with `make ALLOC_STATS=1`.
+ * Replaces global operator new/delete with counting versions and attributes
+ * allocations to processed messages by direction and message type.
+ * The IPK25_ALLOC_BUDGET environment variable sets the allowed average
+ * number of allocations per message, exceeding it fails the process exit code.
+ * Without ALLOC_STATS=1 all functions are empty.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace alloc_stats {
+	enum Direction : uint8_t {
+		INBOUND,
+		OUTBOUND
+	};
+
+#ifdef IPK25_ALLOC_STATS
+	/* Start a new accounting window */
+	void mark();
+
+	/* Attribute allocations since the last mark to one message, start a new window */
+	void account(Direction direction, uint8_t msg_type);
+
+	/* Print per message statistics to stderr, returns non-zero if over budget */
+	int report();
+#else
+	inline void mark() {}
+	inline void account(Direction, uint8_t) {}
+	inline int report() { return 0; }
+#endif
+}
@@ -0,0 +1,189 @@
+#include "analytics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+/* FNV-1a with a murmur finalizer, both halves are used by the sketches */
+uint64_t hash(std::string_view text) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (unsigned char c : text) {
+		h = (h ^ c) * 0x100000001b3ULL;
+	}
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/* Exponential decay of a per second rate */
+double decay(double rate, std::chrono::steady_clock::duration elapsed, double window) {
+	return rate * std::exp(-std::chrono::duration<double>(elapsed).count() / window);
+}
+
+}
+
+/* Conservative update, only the minimal counters are raised */
+uint32_t Analytics::estimate(uint64_t h) {
+	uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32) | 1;
+	uint32_t* cells[DEPTH];
+	uint32_t minimum = UINT32_MAX;
+
+	for (std::size_t row = 0; row < DEPTH; ++row) {
+		cells[row] = &sketch[row][(h1 + row * h2) % WIDTH];
+		minimum = std::min(minimum, *cells[row]);
+	}
+
+	if (minimum != UINT32_MAX) {
+		++minimum;
+	}
+
+	for (uint32_t* cell : cells) {
+		*cell = std::max(*cell, minimum);
+	}
+
+	return minimum;
+}
+
+void Analytics::update(std::string_view sender) {
+	Clock::time_point now = Clock::now();
+	uint64_t h = hash(sender);
+
+	/* Distinct senders, register chosen by the top bits, rank of the rest */
+	uint64_t rest = h << HLL_BITS;
+	uint8_t rank = rest == 0 ? 64 - HLL_BITS + 1 : __builtin_clzll(rest) + 1;
+	uint8_t& reg = registers[h >> (64 - HLL_BITS)];
+
+	reg = std::max(reg, rank);
+
+	rate = decay(rate, now - last, RATE_WINDOW) + 1.0 / RATE_WINDOW;
+	last = now;
+	++total;
+
+	offer(sender, estimate(h), now);
+}
+
+/* Min-heap on the sketch estimate, TOP_K is small enough for a linear membership check */
+void Analytics::offer(std::string_view sender, uint32_t count, Clock::time_point now) {
+	sender = sender.substr(0, MAX_DN_LEN);
+
+	for (std::size_t i = 0; i < top_size; ++i) {
+		Sender& entry = top[i];
+
+		if (std::string_view(entry.name, entry.length) == sender) {
+			entry.count = count;
+			entry.rate = decay(entry.rate, now - entry.last, RATE_WINDOW) + 1.0 / RATE_WINDOW;
+			entry.last = now;
+			sift_down(i);
+			return;
+		}
+	}
+
+	std::size_t i;
+
+	if (top_size < TOP_K) {
+		i = top_size++;
+	}
+	else if (count > top[0].count) {
+		i = 0;
+	}
+	else {
+		return;
+	}
+
+	Sender& entry = top[i];
+
+	std::memcpy(entry.name, sender.data(), sender.length());
+	entry.length = sender.length();
+	entry.count = count;
+	entry.rate = 1.0 / RATE_WINDOW;
+	entry.last = now;
+
+	/* New entries sift up when appended, a replaced root sifts down */
+	if (i == 0) {
+		sift_down(0);
+	}
+	else {
+		for (; i > 0 && top[i].count < top[(i - 1) / 2].count; i = (i - 1) / 2) {
+			std::swap(top[i], top[(i - 1) / 2]);
+		}
+	}
+}
+
+void Analytics::sift_down(std::size_t i) {
+	while (true) {
+		std::size_t smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+
+		if (left < top_size && top[left].count < top[smallest].count) {
+			smallest = left;
+		}
+
+		if (right < top_size && top[right].count < top[smallest].count) {
+			smallest = right;
+		}
+
+		if (smallest == i) {
+			return;
+		}
+
+		std::swap(top[i], top[smallest]);
+		i = smallest;
+	}
+}
+
+/* HyperLogLog estimate with the small range correction (linear counting) */
+double Analytics::cardinality() const {
+	constexpr double m = HLL_REGISTERS;
+	double sum = 0;
+	std::size_t zeros = 0;
+
+	for (uint8_t reg : registers) {
+		sum += std::ldexp(1.0, -reg);
+		zeros += reg == 0;
+	}
+
+	double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+
+	if (estimate <= 2.5 * m && zeros != 0) {
+		estimate = m * std::log(m / zeros);
+	}
+
+	return estimate;
+}
+
+void Analytics::report(std::ostream& os) const {
+	Clock::time_point now = Clock::now();
+	std::array<Sender, TOP_K> sorted = top;
+
+	std::sort(sorted.begin(), sorted.begin() + top_size, [](const Sender& a, const Sender& b) {
+		return a.count > b.count;
+	});
+
+	/* Formatted apart, the caller's stream keeps its flags and precision */
+	std::ostringstream out;
+
+	out << "Messages: " << total
+	    << ", distinct senders: ~" << std::llround(cardinality())
+	    << ", rate: " << std::fixed << std::setprecision(1) << decay(rate, now - last, RATE_WINDOW) * 60 << "/min\n"
+	    << std::left << std::setw(MAX_DN_LEN + 2) << "Display name"
+	    << std::setw(12) << "Messages" << "Rate/min\n";
+
+	for (std::size_t i = 0; i < top_size; ++i) {
+		const Sender& entry = sorted[i];
+
+		out << std::setw(MAX_DN_LEN + 2) << std::string_view(entry.name, entry.length)
+		    << std::setw(12) << entry.count
+		    << decay(entry.rate, now - entry.last, RATE_WINDOW) * 60 << "\n";
+	}
+
+	os << out.str() << std::flush;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file: analytics.hpp
+ *
+ * Streaming chat analytics for /top, fixed memory regardless of the number of senders.
+ * Count-min sketch of messages per display name, a min-heap of the TOP_K heaviest senders
+ * with decaying message rates, HyperLogLog estimate of distinct senders.
+ */
+
+#pragma once
+
+#include "message.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+class Analytics {
+	public:
+		/* Account one inbound chat message, constant time */
+		void update(std::string_view sender);
+
+		/* Print the report */
+		void report(std::ostream& os) const;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		/* Count-min sketch dimensions, ~0.1 % overestimate with 98 % probability */
+		static constexpr std::size_t DEPTH = 4;
+		static constexpr std::size_t WIDTH = 2048;
+
+		/* Tracked heavy hitters */
+		static constexpr std::size_t TOP_K = 10;
+
+		/* HyperLogLog precision, 2^12 registers, ~1.6 % standard error */
+		static constexpr unsigned HLL_BITS = 12;
+		static constexpr std::size_t HLL_REGISTERS = std::size_t(1) << HLL_BITS;
+
+		/* Rate decay time constant, seconds */
+		static constexpr double RATE_WINDOW = 60.0;
+
+		struct Sender {
+			char name[MAX_DN_LEN + 1];
+			uint8_t length;
+			uint32_t count;    // Sketch estimate
+			double rate;       // Decayed messages per second
+			Clock::time_point last;
+		};
+
+		std::array<std::array<uint32_t, WIDTH>, DEPTH> sketch{};
+		std::array<Sender, TOP_K> top{};
+		std::size_t top_size = 0;
+		std::array<uint8_t, HLL_REGISTERS> registers{};
+
+		uint64_t total = 0;
+		double rate = 0;
+		Clock::time_point last{};
+
+		uint32_t estimate(uint64_t hash);
+		void offer(std::string_view sender, uint32_t count, Clock::time_point now);
+		void sift_down(std::size_t i);
+		double cardinality() const;
+};
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <cstdlib>
 #include <stdexcept>
+#include <sched.h>
 
 #include "args.hpp"
 #include "config.hpp"
@@ -69,11 +70,20 @@ void help(char* pname) {
 				<<  pname << " [opts]\n\n"
 				<< "Options:\n"
 				<< "{-t} Transport protocol to be used for connection.\n"
-				<< "{-s} Server IPv4 address | hostname.\n"
+				<< "{-s} Server IPv4/IPv6 address | hostname | unix:path of a Unix-domain socket.\n"
 				<< "[-p] Server port, default = 4567.\n"
 				<< "[-d] UDP confirmation timeout in milliseconds, default = 250 ms.\n"
 				<< "[-r] Maximum number of UDP retransmissions, default = 3.\n"
-				<< "[-h] Prints this help message and terminates the program.\n\n"
+				<< "[-h] Prints this help message and terminates the program.\n"
+				<< "[--io-uring] Socket I/O through io_uring, falls back to system calls when unavailable.\n"
+				<< "[--low-latency] TCP_NODELAY, SO_BUSY_POLL and larger socket buffers.\n"
+				<< "[--spin] Busy-poll budget in microseconds before blocking in poll(), default = 0.\n"
+				<< "[--cpu] Pin the I/O thread to the given CPU.\n"
+				<< "[--history] Record chat messages into the given directory, read back with /history.\n"
+				<< "[--rules] Answer inbound messages by the rules (pattern => response) of the given file.\n"
+				<< "[--daemon] Headless mode, share the session through the given Unix socket instead of stdin.\n"
+				<< "[--gateway] Relay clients of the other transport on the given local port to the server.\n"
+				<< "[--reconnect] Reconnect and resume the session when the connection is lost, backing off up to the given milliseconds.\n\n"
 				<< "Mandatory parameters are inside curly brackets {}.\n"
 				<< "Optional parameters are in square brackets []."
 				<< std::endl;
@@ -96,7 +106,91 @@ int args_parse(int argc, char** argv, Config& config) {
 		char *arg = get_arg(argc, argv, i);
 		char *param = argv[i];
 
-		if (param[0] == '-') {
+		/* Long options */
+		if (std::strncmp(param, "--", 2) == 0) {
+			if (std::strcmp(param, "--io-uring") == 0) {
+				config.io_uring = true;
+			}
+			else if (std::strcmp(param, "--low-latency") == 0) {
+				config.low_latency = true;
+			}
+			else if (std::strcmp(param, "--spin") == 0) {
+				value = to_int(arg);
+
+				if (in_range(value, 1000000) == -1) {
+					local_error("Invalid argument range ", arg);
+					return 1;
+				}
+
+				config.spin_us = value;
+				++i;
+			}
+			else if (std::strcmp(param, "--cpu") == 0) {
+				value = to_int(arg);
+
+				if (in_range(value, CPU_SETSIZE - 1) == -1) {
+					local_error("Invalid argument range ", arg);
+					return 1;
+				}
+
+				config.cpu = value;
+				++i;
+			}
+			else if (std::strcmp(param, "--history") == 0) {
+				if (arg == nullptr) {
+					local_error("Missing history directory");
+					return 1;
+				}
+
+				config.history_dir = arg;
+				++i;
+			}
+			else if (std::strcmp(param, "--rules") == 0) {
+				if (arg == nullptr) {
+					local_error("Missing rule file");
+					return 1;
+				}
+
+				config.rules_file = arg;
+				++i;
+			}
+			else if (std::strcmp(param, "--daemon") == 0) {
+				if (arg == nullptr) {
+					local_error("Missing daemon socket path");
+					return 1;
+				}
+
+				config.daemon_path = arg;
+				++i;
+			}
+			else if (std::strcmp(param, "--gateway") == 0) {
+				value = to_int(arg);
+
+				if (in_range(value, 65535) <= 0) {
+					local_error("Invalid argument range ", arg);
+					return 1;
+				}
+
+				config.gateway_port = value;
+				++i;
+			}
+			else if (std::strcmp(param, "--reconnect") == 0) {
+				value = to_int(arg);
+
+				if (in_range(value, 3600000) <= 0) {
+					local_error("Invalid argument range ", arg);
+					return 1;
+				}
+
+				config.reconnect_ms = value;
+				++i;
+			}
+			else {
+				local_error("Invalid parameter ", param);
+				return 1;
+			}
+		}
+		else if (param[0] == '-') {
 			switch (param[1]) {
 				case 't':
 					config.protocol = parse_protocol(arg);
@@ -110,7 +204,7 @@ int args_parse(int argc, char** argv, Config& config) {
 					value = to_int(arg);
 
 					if (in_range(value, UINT16_MAX) == -1) {
-						local_error(string("Invalid argument range ") + arg);
+						local_error("Invalid argument range ", arg);
 						return 1;
 					}
 
@@ -121,7 +215,7 @@ int args_parse(int argc, char** argv, Config& config) {
 					value = to_int(arg);
 
 					if (in_range(value, UINT16_MAX) == -1) {
-						local_error(string("Invalid argument range ") + arg);
+						local_error("Invalid argument range ", arg);
 						return 1;
 					}
 
@@ -132,7 +226,7 @@ int args_parse(int argc, char** argv, Config& config) {
 					value = to_int(arg);
 
 					if (in_range(value, UINT8_MAX) == -1) {
-						local_error(string("Invalid argument range ") + arg);
+						local_error("Invalid argument range ", arg);
 						return 1;
 					}
 
@@ -144,13 +238,13 @@ int args_parse(int argc, char** argv, Config& config) {
 					break;
 
 				default:
-					local_error(string("Invalid parameter ") + param);
+					local_error("Invalid parameter ", param);
 					break;
 			}
 			++i;
 		}
 		else {
-			local_error(string("Invalid parameter ") + param);
+			local_error("Invalid parameter ", param);
 			return 1;
 		}
 	}
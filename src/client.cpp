@@ -1,25 +1,38 @@
 #include "client.hpp"
+#include "alloc_stats.hpp"
 #include "command.hpp"
 #include "error.hpp"
 #include "message.hpp"
 #include "msg_factory.hpp"
+#include "probe.hpp"
+#include "recorder.hpp"
 #include "signal.hpp"
+#include "tcp.hpp"
+#include "udp.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <ctime>
 #include <cstdlib>
 #include <csignal>
 #include <poll.h>
 #include <string>
 #include <sys/poll.h>
+#include <type_traits>
 #include <unistd.h>
 
 Client::Client(std::unique_ptr<Protocol> protocol)
 	: state {Client::State::START}
 	, display_name{"unknown"}
-	, protocol{std::move(protocol)} {}
+	, protocol{std::move(protocol)}
+	, channel{"default"} {}
 
 void Client::set_state(State new_state) {
+	if (new_state != state) {
+		recorder::record(RecEvent::STATE, static_cast<uint8_t>(state), static_cast<uint16_t>(new_state), 0);
+	}
+
 	state = new_state;
 }
 
@@ -27,11 +40,11 @@ Client::State Client::get_state() {
 	return state;
 }
 
-void Client::set_name(std::string name) {
-	display_name = name;
+void Client::set_name(std::string_view name) {
+	display_name.assign(name); // Reuses the display name buffer
 }
 
-std::string Client::get_name() {
+const std::string& Client::get_name() const {
 	return display_name;
 }
 
@@ -39,10 +52,299 @@ Protocol& Client::get_protocol() {
 	return *protocol.get();
 }
 
-void Client::client_output(std::string msg) {
+void Client::set_history(std::unique_ptr<History> store) {
+	history = std::move(store);
+
+	if (history != nullptr) {
+		search = std::make_unique<SearchIndex>(*history);
+	}
+}
+
+/* Channel joined once the pending request is accepted, see process_msg_queue */
+void Client::request_channel(std::string_view channel_id) {
+	requested_channel.assign(channel_id);
+}
+
+/* Record a chat message, a copy into the mapped history tail */
+void Client::archive(History::Direction direction, std::string_view name, std::string_view content) {
+	if (history != nullptr) {
+		search->add(history->append(direction, channel, name, content), content);
+	}
+}
+
+void Client::print_record(const History::Record& record) {
+	std::time_t seconds = record.timestamp / 1000000000;
+	struct tm local;
+	char stamp[32];
+
+	localtime_r(&seconds, &local);
+	std::strftime(stamp, sizeof(stamp), "%F %T", &local);
+
+	std::cout << "[" << stamp << "] " << record.channel
+			  << (record.direction == History::Direction::OUTBOUND ? " > " : " < ")
+			  << record.name << ": " << record.content << "\n";
+}
+
+void Client::print_history(std::size_t count) {
+	if (history == nullptr) {
+		local_error("Chat history is not enabled, see --history");
+		return;
+	}
+
+	history->last(count, print_record);
+
+	std::cout << std::flush;
+}
+
+void Client::print_search(std::string_view query) {
+	if (search == nullptr) {
+		local_error("Search requires the chat history, see --history");
+		return;
+	}
+
+	auto matches = search->find(query, SEARCH_RESULTS);
+
+	if (matches.empty()) {
+		client_output("No matching messages");
+		return;
+	}
+
+	history->read(matches, print_record);
+
+	std::cout << std::flush;
+}
+
+void Client::print_top() {
+	analytics.report(std::cout);
+}
+
+void Client::set_rules(std::unique_ptr<RuleEngine> engine) {
+	rules = std::move(engine);
+}
+
+void Client::set_daemon(std::unique_ptr<Daemon> server) {
+	api = std::move(server);
+}
+
+void Client::set_reconnect(uint32_t ceiling_ms) {
+	reconnect_ceiling = std::chrono::milliseconds(ceiling_ms);
+	jitter.seed(std::random_device{}());
+}
+
+void Client::remember_auth(std::string_view username, std::string_view secret) {
+	this->username.assign(username);
+	this->secret.assign(secret);
+}
+
+/* Sent once the session is resumed, lost with the process when not reconnecting */
+void Client::hold(std::string_view message) {
+	if (reconnect_ceiling.count() > 0) {
+		held.emplace_back(message);
+	}
+}
+
+/* Connection lost, the next attempt is due after a jittered exponential backoff */
+int Client::connection_lost() {
+	if (reconnect_ceiling.count() == 0) {
+		return CLIENT_ERROR;
+	}
+
+	/* Only an authenticated session is resumed, a resume lost halfway keeps its channel */
+	if (!resuming && state == State::OPEN) {
+		resuming = true;
+		resume_channel = channel;
+	}
+
+	set_state(State::START);
+
+	if (protocol->reconnect()) {
+		local_error("Reconnect setup failed");
+		return CLIENT_ERROR;
+	}
+
+	auto ceiling = std::min<std::chrono::milliseconds>(reconnect_ceiling, RECONNECT_BASE * (1u << std::min(reconnect_attempt, 16u)));
+	auto delay = std::chrono::milliseconds(std::uniform_int_distribution<long>(0, ceiling.count())(jitter));
+
+	reconnect_at = std::chrono::steady_clock::now() + delay;
+	++reconnect_attempt;
+
+	local_error("Connection lost, reconnecting in ", delay.count(), " ms");
+
+	return SUCCESS;
+}
+
+/* Replay AUTH and JOIN of the lost session, then the held messages
+ * Over TCP the JOIN follows the AUTH without waiting, both replies arrive within one round trip.
+ * UDP sends wait for their CONFIRM, there the JOIN waits for the AUTH reply,
+ * as it does over TCP when the transport is only known at run time (DYNAMIC_DISPATCH).
+ */
+template <class Transport>
+int Client::resume() {
+	Transport& transport = static_cast<Transport&>(*protocol);
+	auto& factory = static_cast<typename Transport::Factory&>(transport.get_msg_factory());
+	constexpr bool pipelined = std::is_same_v<Transport, TCP>;
+	bool rejoin = resume_channel != "default";
+	Response response;
+	int result;
+
+	request_channel("default");
+
+	result = transport.send(factory.create_auth_msg(username, display_name, secret));
+
+	if (result == SUCCESS && pipelined && rejoin) {
+		result = transport.send(factory.create_join_msg(resume_channel, display_name));
+	}
+
+	if (result == SUCCESS) {
+		result = transport.await_response(transport.get_timeout(), MsgType::REPLY, response);
+	}
+
+	int reacted = process_msg_queue();
+
+	if (result) {
+		return result == SERVER_EXIT ? SUCCESS : result;
+	}
+
+	if (reacted) {
+		return reacted;
+	}
+
+	/* A rejected AUTH leaves the answer of the pipelined JOIN unread, it must not be taken for a later request */
+	if (pipelined && rejoin && state != State::OPEN && state != State::END && state != State::ERR) {
+		result = transport.await_response(transport.get_timeout(), MsgType::REPLY, response);
+
+		reacted = process_msg_queue();
+
+		if (result && result != TIMEOUT) {
+			return result == SERVER_EXIT ? SUCCESS : result;
+		}
+
+		if (reacted) {
+			return reacted;
+		}
+	}
+
+	if (state != State::OPEN) {
+		local_error("Session could not be resumed, ", held.size(), " held messages dropped");
+		resuming = false;
+		held.clear();
+		return SUCCESS;
+	}
+
+	if (rejoin) {
+		request_channel(resume_channel);
+
+		if (!pipelined) {
+			result = transport.send(factory.create_join_msg(resume_channel, display_name));
+		}
+
+		if (result == SUCCESS) {
+			result = transport.await_response(transport.get_timeout(), MsgType::REPLY, response);
+		}
+
+		reacted = process_msg_queue();
+
+		if (result) {
+			return result == SERVER_EXIT ? SUCCESS : result;
+		}
+
+		if (reacted) {
+			return reacted;
+		}
+	}
+
+	resuming = false;
+
+	while (!held.empty() && state == State::OPEN) {
+		if ((result = transport.send(factory.create_chat_msg(display_name, held.front())))) {
+			return result == SERVER_EXIT ? SUCCESS : result;
+		}
+
+		archive(History::Direction::OUTBOUND, display_name, held.front());
+		held.pop_front();
+	}
+
+	reconnect_attempt = 0;
+
+	return SUCCESS;
+}
+
+/* Rule responses go straight to the server, without a round trip through stdin
+ * The content points into the receive buffer that the sends reuse, so the responses are collected first.
+ * Messages that arrive while a send waits are processed after it, their reactions join the same queue.
+ * A failed send is handled like a failed command: NETWORK_ERROR when the client loop may reconnect.
+ */
+int Client::react(const Response& response) {
+	if (rules == nullptr || state != State::OPEN) {
+		return SUCCESS;
+	}
+
+	rules->scan(response.content, [this](std::string_view reply) {
+		reactions.emplace_back(reply);
+	});
+
+	/* Sent by the outer react */
+	if (reacting) {
+		return SUCCESS;
+	}
+
+	reacting = true;
+
+	int result = SUCCESS;
+
+	while (!reactions.empty() && state == State::OPEN && (result == SUCCESS || result == SERVER_EXIT)) {
+		result = protocol->send(protocol->get_msg_factory().create_chat_msg(display_name, reactions.front()));
+
+		if (result == SUCCESS) {
+			archive(History::Direction::OUTBOUND, display_name, reactions.front());
+		}
+
+		if (result == SUCCESS || result == SERVER_EXIT) {
+			reactions.pop_front();
+		}
+
+		/* Replies and server exit (ERR, BYE) received while the send waited */
+		process_msg_queue();
+	}
+
+	if (result != SUCCESS && result != SERVER_EXIT) {
+		local_error("send() - Unable to send rule response");
+
+		if (result == PROTOCOL_ERROR) {
+			protocol->error(protocol->get_msg_factory().create_err_msg(display_name, "Malformed message"));
+		}
+
+		/* Server unreachable, sent again once the session is resumed */
+		if (result == NETWORK_ERROR || result == TIMEOUT) {
+			for (const std::string& reply : reactions) {
+				hold(reply);
+			}
+
+			result = NETWORK_ERROR;
+		}
+		else {
+			result = CLIENT_ERROR;
+		}
+	}
+	else {
+		result = SUCCESS;
+	}
+
+	reactions.clear();
+	reacting = false;
+
+	return result;
+}
+
+void Client::client_output(std::string_view msg) {
 	std::cout << msg << std::endl;
 }
 
+/* Formats the response straight into the output, no intermediate string */
+void Client::client_output(const Response& response) {
+	std::cout << response << std::endl;
+}
+
 void Client::help() {
 	constexpr int cmd_w = 15;
 	constexpr int param_w = 40;
@@ -64,21 +366,45 @@ void Client::help() {
 				<< std::setw(cmd_w) << "/rename"
 				<< std::setw(param_w) << "{DisplayName}"
 				<< "Changes display name.\n"
+				<< std::setw(cmd_w) << "/history"
+				<< std::setw(param_w) << "{Count}"
+				<< "Prints the last Count recorded chat messages (requires --history).\n"
+				<< std::setw(cmd_w) << "/search"
+				<< std::setw(param_w) << "{Term}..."
+				<< "Prints the latest recorded messages containing all terms (requires --history).\n"
+				<< std::setw(cmd_w) << "/top"
+				<< std::setw(param_w) << "None"
+				<< "Prints the most active senders, their message rates and the number of distinct senders.\n"
 				<< std::setw(cmd_w) << "/help"
 				<< std::setw(param_w) << "None"
 				<< "Prints this help message with command description."
 				<<std::endl;
 }
 
-void Client::process_msg(Response& response) { 
+int Client::process_msg(Response& response) { 
+	PROBE(process_msg, response.type, response.content.size(), 0);
+
 	switch (response.type) {
 		case MSG: {
-			client_output(response.content);
-			break;
+			client_output(response);
+
+			if (api != nullptr) {
+				api->publish(response);
+			}
+
+			analytics.update(response.dname);
+			archive(History::Direction::INBOUND, response.dname, response.content);
+
+			return react(response);
 		}
 
 		case ERR: {
-			client_output(response.content);
+			client_output(response);
+
+			if (api != nullptr) {
+				api->publish(response);
+			}
+
 			set_state(State::ERR);
 			break;
 		}
@@ -91,111 +417,280 @@ void Client::process_msg(Response& response) {
 		default: // Ping, etc. --> skip
 			break;
 	}
+
+	return SUCCESS;
 }
 
-void Client::process_msg_queue() {
+/* Stops at the first message whose rule response failed, the rest stays queued for the resumed session */
+int Client::process_msg_queue() {
 	auto& msg_queue = protocol->get_msg_queue();
 
-	while (!msg_queue.empty()) {
-		Response response = msg_queue.front();
+	while (msg_queue.pop(queued)) {
+		if (queued.type == REPLY) {
+			client_output(queued);
 
-		if (response.type == REPLY) {
-			client_output(response.content);
+			if (api != nullptr) {
+				api->publish(queued);
+			}
 
-			if (response.status == OK) {
+			if (queued.status == OK) {
 				set_state(Client::State::OPEN);
+
+				if (!requested_channel.empty()) {
+					channel.swap(requested_channel);
+				}
 			}
+
+			requested_channel.clear();
 		}
-		else {
-			process_msg(response);
-		} 
+		else if (int result = process_msg(queued)) {
+			return result;
+		}
+	}
+
+	return SUCCESS;
+}
+
+/* Parse and execute a single line of user input */
+template <class Transport>
+int Client::process_line(std::string_view line) {
+	Transport& transport = static_cast<Transport&>(*protocol);
+	auto& factory = static_cast<typename Transport::Factory&>(transport.get_msg_factory());
+	int result = SUCCESS;
+
+	alloc_stats::mark();
 
-		msg_queue.pop();
+	auto cmd = get_command(line);
+
+	/* Command is invalid or empty, skip */
+	if (!cmd.has_value()) {
+		return SUCCESS;
 	}
+
+	/* Execute command routine */
+	if ((result = execute_command<Transport>(*cmd, *this))) {
+		local_error("Command action unsuccessful");
+
+		/* Send ERR message to the server, if an error at the application protocol level occurred */
+		if (result == PROTOCOL_ERROR) {
+			transport.error(factory.create_err_msg(get_name(), "Malformed message"));
+		}
+
+		/* Server unreachable, the client loop may reconnect */
+		if (result == NETWORK_ERROR || result == TIMEOUT) {
+			return NETWORK_ERROR;
+		}
+
+		return CLIENT_ERROR;
+	}
+
+	/* Proccess message queue after finishing command, a failed rule response is handled like the command */
+	return process_msg_queue();
 }
 
+/* Process all complete lines of the input buffer, keeps the incomplete last line
+ * Pasted or scripted input arrives in bulk, on EOF the unterminated last line is processed and the client ends
+ */
+template <class Transport>
+int Client::process_input(std::string& input, bool eof) {
+	std::string_view pending(input);
+	std::size_t end;
+
+	while (state != State::END && state != State::ERR && (end = pending.find('\n')) != std::string_view::npos) {
+		int result = process_line<Transport>(pending.substr(0, end));
+
+		pending.remove_prefix(end + 1);
+
+		/* The failed line is consumed, the lines after it wait for a reconnect */
+		if (result) {
+			input.erase(0, input.size() - pending.size());
+			return result;
+		}
+	}
+
+	if (eof) {
+		if (!pending.empty() && state != State::END && state != State::ERR) {
+			int result = process_line<Transport>(pending);
+
+			if (result) {
+				input.clear();
+				return result;
+			}
+		}
+
+		terminate = 1;
+		set_state(State::END);
+		input.clear();
+
+		return SUCCESS;
+	}
+
+	/* Keep the incomplete line for the next read */
+	input.erase(0, input.size() - pending.size());
+
+	return SUCCESS;
+}
+
+/* Client core loop, specialized per transport
+ * Transport is TCP or UDP (final classes, calls are resolved and inlined at compile time)
+ * or Protocol for the dynamic dispatch build
+ */
+template <class Transport>
 int Client::client_run() {
+	Transport& transport = static_cast<Transport&>(*protocol);
+	auto& factory = static_cast<typename Transport::Factory&>(transport.get_msg_factory());
+
 	/* SIGINT signal catch */
 	if (set_signal()) {
 		return CLIENT_ERROR;
 	}
 
-	/* Connect to server */
-	if (protocol->connect()) {
-		local_error("Connection failed");
-		return PROTOCOL_ERROR;
-	}
-
-	/* POLLING to avoid BLOCKING I/O operations */
-	struct pollfd pfds[2] = {{STDIN_FILENO, POLLIN, 0}, {protocol->get_socket(), POLLIN, 0}};
-	int timeout = -1; // Endless
+	/* POLLING to avoid BLOCKING I/O operations
+	 * Until the connection is set up, the second descriptor tracks its progress
+	 * and user input is held back
+	 * In daemon mode stdin is not read, local connections are polled through the third descriptor
+	 */
+	struct pollfd pfds[3] = {{api == nullptr ? STDIN_FILENO : -1, POLLIN, 0}, {-1, POLLIN, 0}, {-1, POLLIN, 0}};
+	bool eof = false;
 
-	int result = SUCCESS;
 	std::string input = "";
 	Response response;
-	MsgFactory& factory = protocol->get_msg_factory();
 
 	/* Client core loop */
 	while (state != State::END && state != State::ERR && !terminate) {
-		int ready = poll(pfds, 2, timeout);
+		/* Input is held back while reconnecting too, until the backoff delay has passed */
+		auto backoff = std::chrono::duration_cast<std::chrono::milliseconds>(reconnect_at - std::chrono::steady_clock::now());
+
+		if (!transport.is_connected() && backoff.count() <= 0) {
+			/* Connect to server */
+			if (transport.connect_step()) {
+				local_error("Connection failed");
+
+				if (connection_lost()) {
+					return PROTOCOL_ERROR;
+				}
+
+				continue;
+			}
+
+			/* Connected --> resume the lost session, then process the held back input */
+			if (transport.is_connected()) {
+				int result = resuming ? resume<Transport>() : SUCCESS;
+
+				if (result == SUCCESS) {
+					result = process_input<Transport>(input, eof);
+				}
+
+				if (result && ((result != NETWORK_ERROR && result != TIMEOUT) || connection_lost())) {
+					return CLIENT_ERROR;
+				}
+
+				continue;
+			}
+		}
+
+		bool connected = transport.is_connected();
+		bool waiting = !connected && backoff.count() > 0;
+
+		/* UDP may reopen its socket when moving to another server address */
+		pfds[1].fd = connected ? transport.get_socket() : waiting ? -1 : transport.connect_fd();
+		pfds[2].fd = connected && api != nullptr ? api->get_fd() : -1;
+
+		/* Messages left from the previous receive are processed without waiting */
+		bool buffered = connected && transport.pending();
+		int ready = transport.wait(pfds, 3, buffered ? 0 : connected ? -1 : waiting ? backoff.count() : transport.connect_wait());
 
 		/* Poll ready and server connection */
-		if (ready < 0 && errno != EINTR) {
+		if (ready < 0) {
+			/* Interrupted by a signal, revents are not valid */
+			if (errno == EINTR) {
+				continue;
+			}
+
 			local_error("poll() failure");
 			return CLIENT_ERROR;
 		}
 
-		/* STDIN ready --> Command */
+		/* STDIN ready --> Commands, one per line */
 		if (pfds[0].revents & (POLLIN | POLLHUP)) {
-			std::getline(std::cin, input);
-			
-			/* EOF reached --> exit */
-			if (std::cin.eof()) {
-				terminate = 1;
-				set_state(State::END);
-				break;
-			}
-
-			/* Input is not empty */
-			if(!input.empty()) {
-				auto cmd = get_command(input);
-				
-				/* Command is invalid, skip */
-				if (cmd == nullptr) {
+			std::size_t used = input.size();
+
+			input.resize(used + INPUT_CHUNK);
+
+			ssize_t b_in = read(STDIN_FILENO, &input[used], INPUT_CHUNK);
+
+			input.resize(used + (b_in > 0 ? b_in : 0));
+
+			if (b_in < 0) {
+				if (errno == EINTR || errno == EAGAIN) {
 					continue;
 				}
 
-				/* Execute command routine */
-				if ((result = cmd->execute(*this))) {
-					local_error("Command action unsuccessful");
-					
-					/* Send ERR message to the server, if an error at the application protocol level occurred */
-					if (result == PROTOCOL_ERROR) {
-						protocol->error(factory.create_err_msg(get_name(), "Malformed message"));
-					}
+				local_error("read() failure");
+				return CLIENT_ERROR;
+			}
+
+			/* EOF reached --> stop polling stdin */
+			if (b_in == 0) {
+				eof = true;
+				pfds[0].fd = -1;
+			}
+
+			if (connected) {
+				int result = process_input<Transport>(input, eof);
 
+				if (result && (result != NETWORK_ERROR || connection_lost())) {
 					return CLIENT_ERROR;
 				}
+			}
+		}
+
+		if (!connected) {
+			continue;
+		}
 
-				/* Proccess message queue after finishing command */
-				process_msg_queue();
+		/* Local connections ready --> one line of input per INPUT frame
+		 * Frames read after the connection is lost wait in the input buffer for the reconnect
+		 */
+		if ((pfds[2].revents & POLLIN) && api->handle([this, &transport, &input](std::string_view line) -> int {
+			if (state == State::END || state == State::ERR) {
+				return SUCCESS;
 			}
+
+			if (!transport.is_connected()) {
+				input.append(line).push_back('\n');
+				return SUCCESS;
+			}
+
+			int result = process_line<Transport>(line);
+
+			return result == NETWORK_ERROR ? connection_lost() : result;
+		})) {
+			return CLIENT_ERROR;
+		}
+
+		if (!transport.is_connected()) {
+			continue;
 		}
 
 		/* Socket POLLIN */
-		if (pfds[1].revents & POLLIN) {
+		if (buffered || (pfds[1].revents & POLLIN)) {
 			/* Receive the message from the socket */
-			if (protocol->receive()) {
+			if (!buffered && transport.receive()) {
 				local_error("Message could not be received");
-				
-				return CLIENT_ERROR;
+
+				if (connection_lost()) {
+					return CLIENT_ERROR;
+				}
+
+				continue;
 			}
 
 			/* Process and parse the message  */
-			if (protocol->process(response)) {
+			if (transport.process(response)) {
 				local_error("Message could not be processed");
 				
-				protocol->error(factory.create_err_msg(get_name(), "Received a malformed message from the server"));
+				transport.error(factory.create_err_msg(get_name(), "Received a malformed message from the server"));
 				
 				return CLIENT_ERROR;
 			}
@@ -204,14 +699,16 @@ int Client::client_run() {
 				continue;
 			}
 
-			/* Process and handle the message */
-			process_msg(response);
+			/* Process and handle the message, a failed rule response may reconnect */
+			if (int result = process_msg(response); result && (result != NETWORK_ERROR || connection_lost())) {
+				return CLIENT_ERROR;
+			}
 		}
 	}
 
 	/* Disconnect logic on terminate signal (CTRL + (C | D)) */
-	if (terminate) {
-		if (protocol->disconnect(get_name())) {
+	if (terminate && transport.is_connected()) {
+		if (transport.disconnect(get_name())) {
 			return CLIENT_ERROR;
 		}
 	}
@@ -221,4 +718,9 @@ int Client::client_run() {
 	}
 
 	return SUCCESS;
-}
\ No newline at end of file
+}
+
+/* Client loop instantiations */
+template int Client::client_run<TCP>();
+template int Client::client_run<UDP>();
+template int Client::client_run<Protocol>();
\ No newline at end of file
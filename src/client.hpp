@@ -1,9 +1,19 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <random>
 #include <string>
+#include <string_view>
 
+#include "analytics.hpp"
+#include "daemon.hpp"
+#include "history.hpp"
 #include "protocol.hpp"
+#include "rules.hpp"
+#include "search.hpp"
 #include "message.hpp"
 
 class Protocol;
@@ -20,10 +30,13 @@ class Client {
 
 		/* Client */
 		Client(std::unique_ptr<Protocol> protocol);
+
+		template <class Transport>
 		int client_run();
 
 		/* Client info */
-		void client_output(std::string msg);
+		void client_output(std::string_view msg);
+		void client_output(const Response& response);
 		void help();
 
 		/* Client state */
@@ -31,12 +44,33 @@ class Client {
 		State get_state();
 
 		/* Display name */
-		void set_name(std::string name);
-		std::string get_name();
+		void set_name(std::string_view name);
+		const std::string& get_name() const;
 		
 		/* IPK25 & Transport protocol */
 		Protocol& get_protocol();
 
+		/* Chat history, optional */
+		void set_history(std::unique_ptr<History> store);
+		void request_channel(std::string_view channel_id);
+		void archive(History::Direction direction, std::string_view name, std::string_view content);
+		void print_history(std::size_t count);
+		void print_search(std::string_view query);
+
+		/* Inbound chat analytics */
+		void print_top();
+
+		/* Bot rules, reactions to inbound messages */
+		void set_rules(std::unique_ptr<RuleEngine> engine);
+
+		/* Headless mode, input and inbound messages go through the local socket API instead of stdin */
+		void set_daemon(std::unique_ptr<Daemon> server);
+
+		/* Automatic reconnect, the session is resumed with the remembered credentials and channel */
+		void set_reconnect(uint32_t ceiling_ms);
+		void remember_auth(std::string_view username, std::string_view secret);
+		void hold(std::string_view message);
+
 	private:
 		/* Client info */
 		State state;
@@ -45,6 +79,64 @@ class Client {
 		/* IPK25 & Transport protocol */
 		std::unique_ptr<Protocol> protocol;
 
-		void process_msg(Response& response);
-		void process_msg_queue();
+		/* Chat history, channel of the recorded messages, switched by the OK reply of the request */
+		std::unique_ptr<History> history;
+		std::unique_ptr<SearchIndex> search;
+		std::string channel;
+		std::string requested_channel;
+
+		/* Sender statistics of inbound messages */
+		Analytics analytics;
+
+		/* Bot rules, optional */
+		std::unique_ptr<RuleEngine> rules;
+
+		/* Responses copied out of the scanned message, sent once the scan is over */
+		std::deque<std::string> reactions;
+		bool reacting = false;
+
+		int react(const Response& response);
+
+		/* Local socket API, optional */
+		std::unique_ptr<Daemon> api;
+
+		/* Most recent matches printed by /search */
+		static constexpr std::size_t SEARCH_RESULTS = 20;
+
+		static void print_record(const History::Record& record);
+
+		/* Reconnect backoff, full jitter: a random delay up to min(ceiling, RECONNECT_BASE * 2^attempt) */
+		static constexpr std::chrono::milliseconds RECONNECT_BASE{100};
+
+		std::chrono::milliseconds reconnect_ceiling{0};
+		std::chrono::steady_clock::time_point reconnect_at;
+		unsigned reconnect_attempt = 0;
+		std::minstd_rand jitter;
+
+		/* Session replayed after a reconnect */
+		bool resuming = false;
+		std::string resume_channel;
+		std::string username;
+		std::string secret;
+		std::deque<std::string> held; // Chat messages whose send failed with the connection
+
+		int connection_lost();
+
+		template <class Transport>
+		int resume();
+
+		/* Message handed over from the protocol message queue */
+		Response queued;
+
+		int process_msg(Response& response);
+		int process_msg_queue();
+
+		/* User input */
+		static constexpr std::size_t INPUT_CHUNK = 4096;
+
+		template <class Transport>
+		int process_line(std::string_view line);
+
+		template <class Transport>
+		int process_input(std::string& input, bool eof);
 };
\ No newline at end of file
@@ -4,182 +4,200 @@
 #include "message.hpp"
 #include "msg_factory.hpp"
 #include "protocol.hpp"
+#include "schema.hpp"
+#include "tcp.hpp"
+#include "udp.hpp"
 
+#include <algorithm>
+#include <charconv>
 #include <cstdlib>
 #include <cstring>
-#include <iostream>
-#include <memory>
-#include <sstream>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <variant>
 #include <cctype>
 
-bool auth_param_valid(std::string username, std::string secret, std::string display_name) {
-	/* Check if its not empty */
-	if (username.empty() || secret.empty() || display_name.empty()) {
+/**
+ * Command parse functions, parameters are validated against the message schema fields
+ */
+bool parse_auth(const std::string_view* params, std::optional<Command>& command) {
+	/* /auth {Username} {Secret} {DisplayName} */
+	if (schema::valid<AUTH>({params[0], params[2], params[1]}) == false) {
 		return false;
 	}
 
-	/* Check valid chars */
-	if (valid_char(username) == false || valid_char(secret) == false || valid_printable(display_name) == false) {
-		return false;
-	}
+	command.emplace(std::in_place_type<AuthCommand>, AuthCommand{params[0], params[1], params[2]});
 
-	/* Check length */
-	if (username.length() > MAX_ID_LEN || secret.length() > MAX_SECRET_LEN || display_name.length() > MAX_DN_LEN) {
+	return true;
+}
+
+bool parse_join(const std::string_view* params, std::optional<Command>& command) {
+	/* /join {ChannelID} */
+	if (schema::valid(schema::Schema<JOIN>::fields[0], params[0]) == false) {
 		return false;
 	}
 
+	command.emplace(std::in_place_type<JoinCommand>, JoinCommand{params[0]});
+
 	return true;
 }
 
-bool join_param_valid(std::string channel_id) {
-	if (channel_id.empty()) {
+bool parse_rename(const std::string_view* params, std::optional<Command>& command) {
+	/* /rename {DisplayName} */
+	if (schema::valid(schema::Schema<MSG>::fields[0], params[0]) == false) {
 		return false;
 	}
 
-	/* UNCOMMENT!!! */
-/*	if (valid_char(channel_id) == false) {
-		return false;
-	}*/
+	command.emplace(std::in_place_type<RenameCommand>, RenameCommand{params[0]});
 
-	if (channel_id.length() > MAX_CID_LEN) {
-		return false;
-	}
+	return true;
+}
+
+bool parse_help(const std::string_view* params, std::optional<Command>& command) {
+	command.emplace(std::in_place_type<HelpCommand>);
 
 	return true;
 }
 
-bool rename_param_valid(std::string display_name) {
-	if (display_name.empty()) {
-		return false;
-	}
+bool parse_history(const std::string_view* params, std::optional<Command>& command) {
+	/* /history {Count} */
+	std::size_t count = 0;
+	auto [end, error] = std::from_chars(params[0].data(), params[0].data() + params[0].length(), count);
 
-	if (valid_printable(display_name) == false) {
+	if (error != std::errc() || end != params[0].data() + params[0].length() || count == 0) {
 		return false;
 	}
 
-	if (display_name.length() > MAX_DN_LEN) {
+	command.emplace(std::in_place_type<HistoryCommand>, HistoryCommand{count});
+
+	return true;
+}
+
+bool parse_search(const std::string_view* params, std::optional<Command>& command) {
+	/* /search {Term}... */
+	if (params[0].empty()) {
 		return false;
 	}
 
+	command.emplace(std::in_place_type<SearchCommand>, SearchCommand{params[0]});
+
 	return true;
 }
 
+bool parse_top(const std::string_view* params, std::optional<Command>& command) {
+	command.emplace(std::in_place_type<TopCommand>);
+
+	return true;
+}
+
+/* Command dispatch table */
+struct CommandEntry {
+	std::string_view name;                                                    // Command name, including the slash
+	std::size_t params;                                                       // Number of parameters, or REST_OF_LINE
+	bool (*parse)(const std::string_view* params, std::optional<Command>& command); // Validate and construct
+	const char* error;                                                        // Invalid parameters error message
+};
+
+constexpr std::size_t MAX_PARAMS = 3;
+
+/* The rest of the line is the only parameter */
+constexpr std::size_t REST_OF_LINE = MAX_PARAMS + 1;
+
+constexpr CommandEntry commands[] = {
+	{"/auth",    3,            parse_auth,    "Invalid '/auth' parameters"},
+	{"/join",    1,            parse_join,    "Invalid '/join' parameters"},
+	{"/rename",  1,            parse_rename,  "Invalid '/rename' parameters"},
+	{"/history", 1,            parse_history, "Invalid '/history' parameters, expected a positive count"},
+	{"/search",  REST_OF_LINE, parse_search,  "'/search' requires at least one term"},
+	{"/top",     0,            parse_top,     "'/top' does not require any additional parameters!"},
+	{"/help",    0,            parse_help,    "'/help' does not require any additional parameters!"}
+};
+
 /**
  * Command parse function
  */
-std::unique_ptr<Command> get_command(std::string input) {
-	using namespace std;
-
-	std::unique_ptr<Command> command;
-	istringstream input_stream(input);
-	string cmd, username, secret, display_name, channel_id; 
-
-	input_stream >> cmd;
+std::optional<Command> get_command(std::string_view input) {
+	std::optional<Command> command;
+	std::string_view rest = input;
+	std::string_view cmd = schema::detail::next_token(rest);
+
+	/* Empty or whitespace only input, skip */
+	if (cmd.empty()) {
+		return command;
+	}
 
 	if (cmd.front() == '/') {
-		if (cmd == "/auth") {
-			input_stream >> username;
-			input_stream >> secret;
-			input_stream >> display_name;
-
-			if (auth_param_valid(username, secret, display_name) == false || !input_stream.eof()) {
-				local_error("Invalid '/auth' parameters");
-				return nullptr;
+		for (const CommandEntry& entry : commands) {
+			if (entry.name != cmd) {
+				continue;
 			}
 
-			command = std::make_unique<AuthCommand>(username, secret, display_name);
-		}
-		else if (cmd == "/join") {
-			input_stream >> channel_id;
+			std::string_view params[MAX_PARAMS];
 
-			if (join_param_valid(channel_id) == false || !input_stream.eof()) {
-				local_error("Invalid '/join' parameters");
-				return nullptr;
+			if (entry.params == REST_OF_LINE) {
+				params[0] = rest.substr(std::min(rest.find_first_not_of(" \t"), rest.length()));
+				rest = {};
 			}
-
-			command = std::make_unique<JoinCommand>(channel_id);
-		}
-		else if (cmd == "/rename") {
-			input_stream >> display_name;
-
-			if (rename_param_valid(display_name) == false || !input_stream.eof()) {
-				local_error("Invalid '/rename' parameters");
-				return nullptr;
+			else {
+				for (std::size_t i = 0; i < entry.params; ++i) {
+					params[i] = schema::detail::next_token(rest);
+				}
 			}
 
-			command = std::make_unique<RenameCommand>(display_name);
-		}
-		else if (cmd == "/help") {
-			if (!input_stream.eof()) {
-				local_error("'/help' does not require any additional parameters!");
-				return nullptr;
+			/* Exactly the number of parameters the command takes */
+			if (schema::detail::next_token(rest).empty() == false || entry.parse(params, command) == false) {
+				local_error(entry.error);
+				command.reset();
 			}
 
-			command = std::make_unique<HelpCommand>();
-		}
-		else {
-			local_error("Invalid command '" + cmd + "', try /help");
-			return nullptr;
-		}
-	}
-	else {
-		if (valid_printable_msg(input) == false) {
-			local_error("Invalid chat message contents");
-			return nullptr;
+			return command;
 		}
 
-		if (input.length() > MAX_MSG_LEN) {
-			local_error("Chat message exceeds the 60 000 character limit - message will be truncated");
-			input = input.substr(0, MAX_MSG_LEN);
-		}
+		local_error("Invalid command '", cmd, "', try /help");
 
-		command = std::make_unique<MsgCommand>(input);
+		return command;
 	}
 
-	return command;
-}
-
-/** 
- *	Command constructors
- */
-AuthCommand::AuthCommand(std::string username, std::string secret, std::string display_name)
-	: username{username}
-	, secret{secret}
-	, display_name{display_name} {}
+	if (valid_printable_msg(input) == false) {
+		local_error("Invalid chat message contents");
+		return command;
+	}
 
-JoinCommand::JoinCommand(std::string channel_id): channel_id{channel_id} {}
+	if (input.length() > MAX_MSG_LEN) {
+		local_error("Chat message exceeds the 60 000 character limit - message will be truncated");
+		input = input.substr(0, MAX_MSG_LEN);
+	}
 
-RenameCommand::RenameCommand(std::string display_name): display_name{display_name} {}
+	command.emplace(std::in_place_type<MsgCommand>, MsgCommand{input});
 
-MsgCommand::MsgCommand(std::string message): message{message} {}
+	return command;
+}
 
 /**
- *	Command public methods
+ * Command execution, dispatched on the variant type
  */
-bool Command::undefined() {
-	return type == Type::UNDEF; 
-}
-
-/* debug function */
-void print_msg(std::string msg) {
-	for (int i = 0; i < msg.length(); ++i) {
-		char c = msg[i];
-		int x = c;
-		std::cout << c << "(" << x << ")";
-	}
-	std::cout << std::endl;
+template <class Transport>
+int execute_command(const Command& command, Client& client) {
+	return std::visit([&client](const auto& cmd) {
+		return cmd.template execute<Transport>(client);
+	}, command);
 }
 
 /* AUTH /auth command */
-int AuthCommand::execute(Client& client) {
-	Protocol& p = client.get_protocol();
-	MsgFactory& f = p.get_msg_factory();
+template <class Transport>
+int AuthCommand::execute(Client& client) const {
+	Transport& p = static_cast<Transport&>(client.get_protocol());
+	auto& f = static_cast<typename Transport::Factory&>(p.get_msg_factory());
 	Response response = {.type = UNKNOWN, .status = NONE, .duplicate = false};
 	int result = SUCCESS;
 
 	if (client.get_state() != Client::State::OPEN) {
 		client.set_name(display_name);
+		client.remember_auth(username, secret);
+
+		/* Servers place authenticated users in the default channel */
+		client.request_channel("default");
 
 		if ((result = p.send(f.create_auth_msg(username, display_name, secret)))) {
 			/* Handle server exit message later */
@@ -210,13 +228,16 @@ int AuthCommand::execute(Client& client) {
 }
 
 /* JOIN /join command */
-int JoinCommand::execute(Client& client) {
-	Protocol& p = client.get_protocol();
-	MsgFactory& f = p.get_msg_factory();
+template <class Transport>
+int JoinCommand::execute(Client& client) const {
+	Transport& p = static_cast<Transport&>(client.get_protocol());
+	auto& f = static_cast<typename Transport::Factory&>(p.get_msg_factory());
 	Response response = {.type = UNKNOWN, .status = NONE, .duplicate = false};
 	int result = SUCCESS;
 
 	if (client.get_state() == Client::State::OPEN) {
+		client.request_channel(channel_id);
+
 		if ((result = p.send(f.create_join_msg(channel_id, client.get_name())))) {
 			/* Handle server exit message later */
 			if (result == SERVER_EXIT) {
@@ -246,23 +267,50 @@ int JoinCommand::execute(Client& client) {
 }
 
 /* RENAME /rename command */
-int RenameCommand::execute(Client& client) {
+template <class Transport>
+int RenameCommand::execute(Client& client) const {
 	client.set_name(display_name);
 
 	return SUCCESS;
 }
 
 /* HELP /help command */
-int HelpCommand::execute(Client& client) {
+template <class Transport>
+int HelpCommand::execute(Client& client) const {
 	client.help();
 	
 	return SUCCESS;
 }
 
+/* HISTORY /history command */
+template <class Transport>
+int HistoryCommand::execute(Client& client) const {
+	client.print_history(count);
+
+	return SUCCESS;
+}
+
+/* SEARCH /search command */
+template <class Transport>
+int SearchCommand::execute(Client& client) const {
+	client.print_search(terms);
+
+	return SUCCESS;
+}
+
+/* TOP /top command */
+template <class Transport>
+int TopCommand::execute(Client& client) const {
+	client.print_top();
+
+	return SUCCESS;
+}
+
 /* MSG standard chat message */
-int MsgCommand::execute(Client& client) {
-	Protocol& p = client.get_protocol();
-	MsgFactory& f = p.get_msg_factory();
+template <class Transport>
+int MsgCommand::execute(Client& client) const {
+	Transport& p = static_cast<Transport&>(client.get_protocol());
+	auto& f = static_cast<typename Transport::Factory&>(p.get_msg_factory());
 	int result = SUCCESS;
 
 	if (client.get_state() == Client::State::OPEN) {
@@ -274,12 +322,22 @@ int MsgCommand::execute(Client& client) {
 
 			local_error("send() - Unable to reach server");	
 
+			/* Sent again once the session is resumed */
+			client.hold(message);
+
 			return result;
 		}
+
+		client.archive(History::Direction::OUTBOUND, client.get_name(), message);
 	}
 	else {
 		local_error("Authentication required to send chat messages");
 	}
 
 	return SUCCESS;
-}
\ No newline at end of file
+}
+
+/* Command execution instantiations */
+template int execute_command<TCP>(const Command& command, Client& client);
+template int execute_command<UDP>(const Command& command, Client& client);
+template int execute_command<Protocol>(const Command& command, Client& client);
\ No newline at end of file
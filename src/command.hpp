@@ -1,59 +1,81 @@
 #pragma once
 
 #include "client.hpp"
-#include <string>
 
-struct Command {
-	enum class Type {
-		AUTH,
-		JOIN,
-		RENAME,
-		HELP,
-		MSG,
-		UNDEF
-	};
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <variant>
 
-	Type type;
-	bool undefined();
-	virtual ~Command() = default;
-	virtual int execute(Client& client) = 0;
+/**
+ * Commands are small structs holding views into the input line,
+ * valid while the line is being processed.
+ * Execution is specialized per transport, see Client::client_run.
+ */
+struct AuthCommand {
+	std::string_view username,
+					 secret,
+					 display_name;
+
+	template <class Transport>
+	int execute(Client& client) const;
+};
+
+struct JoinCommand {
+	std::string_view channel_id;
+
+	template <class Transport>
+	int execute(Client& client) const;
 };
 
-struct AuthCommand : public Command {
-	std::string username,
-				secret,
-				display_name;
+struct RenameCommand {
+	std::string_view display_name;
 
-	AuthCommand(std::string username, std::string secret, std::string display_name);
-	int execute(Client& client) override;
+	template <class Transport>
+	int execute(Client& client) const;
 };
 
-struct JoinCommand : public Command {
-	std::string channel_id;
+struct HelpCommand {
+	template <class Transport>
+	int execute(Client& client) const;
+};
+
+struct HistoryCommand {
+	std::size_t count;
 
-	JoinCommand(std::string channel_id);
-	int execute(Client& client) override;
+	template <class Transport>
+	int execute(Client& client) const;
 };
 
-struct RenameCommand : public Command {
-	std::string display_name;
+struct SearchCommand {
+	std::string_view terms;
 
-	RenameCommand(std::string display_name);
-	int execute(Client& client) override;
+	template <class Transport>
+	int execute(Client& client) const;
 };
 
-struct HelpCommand : public Command {
-	int execute(Client& client) override;
+struct TopCommand {
+	template <class Transport>
+	int execute(Client& client) const;
 };
 
-struct MsgCommand : public Command {
-	std::string message;
+struct MsgCommand {
+	std::string_view message;
 
-	MsgCommand(std::string message);
-	int execute(Client& client) override;
+	template <class Transport>
+	int execute(Client& client) const;
 };
 
+/* Tagged command variant, constructed in place by the parser */
+using Command = std::variant<AuthCommand, JoinCommand, RenameCommand, HelpCommand, HistoryCommand, SearchCommand, TopCommand, MsgCommand>;
+
+/**
+ * Command parse and get function, empty if the input is not a valid command
+ */
+std::optional<Command> get_command(std::string_view input);
+
 /**
- * Command parse and get function
+ * Command execution
  */
-std::unique_ptr<Command> get_command(std::string input);
\ No newline at end of file
+template <class Transport>
+int execute_command(const Command& command, Client& client);
@@ -11,10 +11,19 @@ struct Config {
 	};
 
 	Protocol protocol;          // Chosen transport protocol
-	char *ip_hostname;          // Server IPv4/Hostname address
+	char *ip_hostname;          // Server IPv4/IPv6/Hostname address or unix:path
 	uint16_t server_port;       // Server port
 	uint16_t udp_timeout;       // UDP confirmation timeout
 	uint8_t udp_retransmission; // Number of udp packet retransmissions
+	bool io_uring;              // io_uring I/O backend
+	bool low_latency;           // Latency socket tuning
+	uint32_t spin_us;           // Busy-poll budget before blocking in poll(), microseconds
+	int cpu;                    // CPU the I/O thread is pinned to, -1 when not pinned
+	char *history_dir;          // Chat history store directory, nullptr when disabled
+	char *rules_file;           // Bot rule file, nullptr when disabled
+	char *daemon_path;          // Local socket of the daemon mode, nullptr when reading stdin
+	uint16_t gateway_port;      // Local port of the gateway mode, 0 when disabled
+	uint32_t reconnect_ms;      // Backoff ceiling of automatic reconnects in milliseconds, 0 when disabled
 
 	/* Default constructor */
 	Config() {
@@ -24,5 +33,14 @@ struct Config {
 		server_port = 4567;
 		udp_timeout = 250;
 		udp_retransmission = 3;
+		io_uring = false;
+		low_latency = false;
+		spin_us = 0;
+		cpu = -1;
+		history_dir = nullptr;
+		rules_file = nullptr;
+		daemon_path = nullptr;
+		gateway_port = 0;
+		reconnect_ms = 0;
 	}
 };
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "daemon.hpp"
+#include "error.hpp"
+#include "resolver.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+std::string frame_header(uint8_t type, std::size_t length) {
+	std::string frame;
+
+	frame.reserve(3 + length);
+	frame.push_back(static_cast<char>(type));
+	frame.push_back(static_cast<char>(length >> 8));
+	frame.push_back(static_cast<char>(length & 0xff));
+
+	return frame;
+}
+
+}
+
+std::unique_ptr<Daemon> Daemon::listen(const char* path) {
+	std::unique_ptr<Daemon> daemon(new Daemon());
+	Endpoint endpoint;
+
+	if (!unix_endpoint(path, endpoint)) {
+		local_error("Invalid daemon socket path ", path);
+		return nullptr;
+	}
+
+	daemon->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	daemon->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (daemon->listen_fd < 0 || daemon->epoll_fd < 0) {
+		local_error("Daemon socket setup");
+		return nullptr;
+	}
+
+	const auto* address = reinterpret_cast<const struct sockaddr*>(&endpoint.address);
+
+	/* A socket file nobody listens on is left over from a previous daemon */
+	if (path[0] != '@') {
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+		if (probe >= 0 && connect(probe, address, endpoint.length) == 0) {
+			close(probe);
+			local_error("Daemon socket ", path, " is in use");
+			return nullptr;
+		}
+
+		if (probe >= 0) {
+			close(probe);
+		}
+
+		unlink(path);
+		daemon->path = path;
+	}
+
+	if (bind(daemon->listen_fd, address, endpoint.length) != 0 || ::listen(daemon->listen_fd, SOMAXCONN) != 0) {
+		local_error("Unable to listen on ", path, " - ", std::strerror(errno));
+		return nullptr;
+	}
+
+	struct epoll_event event = {};
+
+	event.events = EPOLLIN;
+	event.data.fd = daemon->listen_fd;
+
+	if (epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, daemon->listen_fd, &event) != 0) {
+		local_error("epoll_ctl()");
+		return nullptr;
+	}
+
+	log("[DAEMON] listening on ", path);
+
+	return daemon;
+}
+
+Daemon::~Daemon() {
+	for (auto& [fd, connection] : connections) {
+		close(fd);
+	}
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+	}
+
+	if (epoll_fd >= 0) {
+		close(epoll_fd);
+	}
+
+	if (!path.empty()) {
+		unlink(path.c_str());
+	}
+}
+
+int Daemon::get_fd() const {
+	return epoll_fd;
+}
+
+void Daemon::accept_all() {
+	int fd;
+
+	while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		struct epoll_event event = {};
+
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			close(fd);
+			continue;
+		}
+
+		connections.emplace(fd, Connection{fd});
+		log("[DAEMON] connection ", fd);
+	}
+}
+
+int Daemon::handle(const std::function<int(std::string_view)>& line) {
+	struct epoll_event events[16];
+	int ready = epoll_wait(epoll_fd, events, 16, 0);
+
+	handling = true;
+
+	for (int i = 0; i < ready; ++i) {
+		if (events[i].data.fd == listen_fd) {
+			accept_all();
+			continue;
+		}
+
+		auto it = connections.find(events[i].data.fd);
+
+		if (it == connections.end() || it->second.closed) {
+			continue;
+		}
+
+		Connection& connection = it->second;
+
+		/* A hung up peer is not written to, receive reads its last frames and closes it */
+		if ((events[i].events & EPOLLOUT) && !(events[i].events & (EPOLLHUP | EPOLLERR))) {
+			flush(connection);
+		}
+
+		if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && receive(connection, line)) {
+			handling = false;
+			sweep();
+			return CLIENT_ERROR;
+		}
+	}
+
+	handling = false;
+	sweep();
+
+	return SUCCESS;
+}
+
+/* Read and dispatch complete frames */
+int Daemon::receive(Connection& connection, const std::function<int(std::string_view)>& line) {
+	char chunk[4096];
+	ssize_t bytes;
+
+	while ((bytes = read(connection.fd, chunk, sizeof(chunk))) > 0) {
+		connection.in.append(chunk, bytes);
+	}
+
+	if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR)) {
+		close_connection(connection);
+	}
+
+	std::size_t used = 0;
+
+	while (connection.in.size() - used >= HEADER) {
+		const auto* header = reinterpret_cast<const uint8_t*>(connection.in.data() + used);
+		std::size_t length = (header[1] << 8) | header[2];
+
+		if (connection.in.size() - used < HEADER + length) {
+			break;
+		}
+
+		std::string_view payload(connection.in.data() + used + HEADER, length);
+
+		used += HEADER + length;
+
+		switch (header[0]) {
+			case INPUT:
+				/* Frames of a closed connection are still executed, they were sent before it closed */
+				if (line(payload)) {
+					return CLIENT_ERROR;
+				}
+				break;
+
+			case SUBSCRIBE:
+				connection.subscribed = true;
+				break;
+
+			case UNSUBSCRIBE:
+				connection.subscribed = false;
+				break;
+
+			default:
+				local_error("Daemon - unknown frame type ", static_cast<int>(header[0]));
+				close_connection(connection);
+				used = connection.in.size();
+				break;
+		}
+	}
+
+	connection.in.erase(0, used);
+
+	return SUCCESS;
+}
+
+/* Write queued frames until the socket would block
+ * A peer that went away fails the send with EPIPE instead of raising SIGPIPE, and is closed like on any other error.
+ */
+void Daemon::flush(Connection& connection) {
+	while (!connection.out.empty() && !connection.closed) {
+		const std::string& frame = *connection.out.front();
+		ssize_t bytes = send(connection.fd, frame.data() + connection.offset, frame.size() - connection.offset, MSG_NOSIGNAL);
+
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno != EAGAIN) {
+				close_connection(connection);
+			}
+
+			break;
+		}
+
+		connection.offset += bytes;
+
+		if (connection.offset == frame.size()) {
+			connection.out.pop_front();
+			connection.offset = 0;
+		}
+	}
+
+	/* Wait for writability only while something is queued */
+	bool writing = !connection.out.empty() && !connection.closed;
+
+	if (writing != connection.writing) {
+		struct epoll_event event = {};
+
+		event.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+		event.data.fd = connection.fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+		connection.writing = writing;
+	}
+}
+
+void Daemon::publish(const Response& response) {
+	std::string frame;
+
+	switch (response.type) {
+		case MSG:
+		case ERR: {
+			std::string_view name = response.dname.substr(0, 255);
+
+			frame = frame_header(response.type == MSG ? FRAME_MSG : FRAME_ERR, 1 + name.length() + response.content.length());
+			frame.push_back(static_cast<char>(name.length()));
+			frame.append(name);
+			break;
+		}
+
+		case REPLY:
+			frame = frame_header(FRAME_REPLY, 1 + response.content.length());
+			frame.push_back(response.status == OK ? 1 : 0);
+			break;
+
+		default:
+			return;
+	}
+
+	frame.append(response.content);
+
+	/* Messages are limited to 60 000 characters, frames always fit the 16-bit length */
+	Frame shared = std::make_shared<const std::string>(std::move(frame));
+
+	for (auto& [fd, connection] : connections) {
+		if (!connection.subscribed || connection.closed) {
+			continue;
+		}
+
+		if (connection.out.size() >= MAX_BACKLOG) {
+			local_error("Daemon - subscriber ", fd, " is too slow, dropped");
+			close_connection(connection);
+			continue;
+		}
+
+		connection.out.push_back(shared);
+		flush(connection);
+	}
+
+	if (!handling) {
+		sweep();
+	}
+}
+
+/* Closed connections stay in the table until sweep, handle may be iterating over them */
+void Daemon::close_connection(Connection& connection) {
+	if (!connection.closed) {
+		connection.closed = true;
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+	}
+}
+
+void Daemon::sweep() {
+	for (auto it = connections.begin(); it != connections.end();) {
+		if (it->second.closed) {
+			log("[DAEMON] closed ", it->first);
+			close(it->first);
+			it = connections.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
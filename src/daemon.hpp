@@ -0,0 +1,84 @@
+/**
+ * @file: daemon.hpp
+ *
+ * Headless daemon mode, enabled by --daemon <path>. One server session is shared by local
+ * processes connected to a Unix-domain socket (path, or @name for the abstract namespace).
+ *
+ * Frames: <type:u8> <length:u16, network order> <payload>
+ *   INPUT     (tool -> daemon)  one line of input, same syntax as stdin (commands or a chat message)
+ *   SUBSCRIBE (tool -> daemon)  start receiving inbound messages, UNSUBSCRIBE stops
+ *   MSG, ERR  (daemon -> tool)  <name length:u8> <display name> <content>
+ *   REPLY     (daemon -> tool)  <status:u8, 1 = OK> <content>
+ *
+ * Inbound messages are encoded once, subscribers share the frame and keep only a write offset.
+ */
+
+#pragma once
+
+#include "message.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class Daemon {
+	public:
+		enum FrameType : uint8_t {
+			INPUT = 0x01,
+			SUBSCRIBE = 0x02,
+			UNSUBSCRIBE = 0x03,
+			FRAME_MSG = 0x81,
+			FRAME_ERR = 0x82,
+			FRAME_REPLY = 0x83
+		};
+
+		static std::unique_ptr<Daemon> listen(const char* path);
+		~Daemon();
+
+		/* Readable when a local connection needs attention */
+		int get_fd() const;
+
+		/* Accept, read and write ready connections, INPUT frames are handed over as lines */
+		int handle(const std::function<int(std::string_view)>& line);
+
+		/* Fan an inbound MSG, ERR or REPLY out to the subscribers */
+		void publish(const Response& response);
+
+	private:
+		/* Frame header length */
+		static constexpr std::size_t HEADER = 3;
+
+		/* Frames queued for a subscriber before it is dropped as too slow */
+		static constexpr std::size_t MAX_BACKLOG = 4096;
+
+		using Frame = std::shared_ptr<const std::string>;
+
+		struct Connection {
+			int fd;
+			std::string in;
+			std::deque<Frame> out;
+			std::size_t offset = 0; // Written bytes of the first queued frame
+			bool subscribed = false;
+			bool writing = false;   // Registered for EPOLLOUT
+			bool closed = false;    // Removed after the current event round
+		};
+
+		Daemon() = default;
+
+		std::string path;
+		int listen_fd = -1;
+		int epoll_fd = -1;
+		std::unordered_map<int, Connection> connections;
+		bool handling = false; // Inside handle, connections are swept at its end
+
+		void accept_all();
+		int receive(Connection& connection, const std::function<int(std::string_view)>& line);
+		void flush(Connection& connection);
+		void close_connection(Connection& connection);
+		void sweep();
+};
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <iostream>
+#include "logger.hpp"
 
 /* Enum containing various exit/return codes */
 enum Error : int {
@@ -16,12 +16,14 @@ enum Error : int {
 	SERVER_EXIT = 80     // BYE, ERR packet received from a server, used primarily for UDP 
 };
 
-/* Local client error */
-inline void local_error(const std::string& msg) {
-	std::cout << "ERROR: " << msg << std::endl;
+/* Local client error, arguments are concatenated */
+template <class... Args>
+inline void local_error(const Args&... msg) {
+	logger::write<logger::Level::ERROR>("ERROR: ", msg...);
 }
 
-/* Log function, used for debugging purposes */
-inline void log(const std::string& msg) {
-	std::cerr << "\033[36m[LOG]\033[0m " << msg << std::endl;
+/* Log function, used for debugging purposes, compiled out by default */
+template <class... Args>
+inline void log(const Args&... msg) {
+	logger::write<logger::Level::DEBUG>("\033[36m[LOG]\033[0m ", msg...);
 }
\ No newline at end of file
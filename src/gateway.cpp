@@ -0,0 +1,605 @@
+#include "gateway.hpp"
+#include "error.hpp"
+#include "protocol.hpp"
+#include "signal.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+/* Receive size, a full datagram */
+constexpr std::size_t DATAGRAM_MAX = 65536;
+
+/* Display name of messages created by the gateway itself */
+constexpr std::string_view GATEWAY_NAME = "gateway";
+
+/* Dual-stack socket bound to the port on all addresses, plain IPv4 when IPv6 is unavailable */
+int bind_any(int type, uint16_t port) {
+	int fd = socket(AF_INET6, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int on = 1, off = 0;
+
+	if (fd >= 0) {
+		struct sockaddr_in6 address = {};
+
+		address.sin6_family = AF_INET6;
+		address.sin6_addr = in6addr_any;
+		address.sin6_port = htons(port);
+
+		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		if (bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0) {
+			return fd;
+		}
+
+		close(fd);
+	}
+
+	fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd >= 0) {
+		struct sockaddr_in address = {};
+
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		if (bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0) {
+			return fd;
+		}
+
+		close(fd);
+	}
+
+	return -1;
+}
+
+/* Address bytes as a map key */
+std::string address_key(const struct sockaddr_storage& address, socklen_t length) {
+	return std::string(reinterpret_cast<const char*>(&address), length);
+}
+
+}
+
+Gateway::Gateway(const Config& config)
+	: server_udp{config.protocol == Config::Protocol::UDP}
+	, port{config.gateway_port}
+	, host{config.ip_hostname}
+	, server_port{config.server_port}
+	, confirm_timeout{config.udp_timeout}
+	, retransmissions{config.udp_retransmission} {}
+
+Gateway::~Gateway() {
+	for (auto& [id, session] : sessions) {
+		close_session(*session);
+	}
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+	}
+
+	if (epoll_fd >= 0) {
+		close(epoll_fd);
+	}
+}
+
+/* Resolve the server once, all sessions use the same address */
+int Gateway::setup() {
+	Resolver resolver;
+	std::vector<Endpoint> endpoints;
+
+	if (resolver.start(host, server_port, server_udp ? SOCK_DGRAM : SOCK_STREAM)) {
+		return ADDRESS_ERROR;
+	}
+
+	if (resolver.pending()) {
+		struct pollfd pfd = {resolver.get_fd(), POLLIN, 0};
+
+		poll(&pfd, 1, 5000);
+	}
+
+	if (resolver.result(endpoints)) {
+		return ADDRESS_ERROR;
+	}
+
+	server = endpoints.front();
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	listen_fd = bind_any(server_udp ? SOCK_STREAM : SOCK_DGRAM, port);
+
+	if (epoll_fd < 0 || listen_fd < 0 || (server_udp && listen(listen_fd, SOMAXCONN) != 0)) {
+		local_error("Unable to listen on port ", port, " - ", std::strerror(errno));
+		return NETWORK_ERROR;
+	}
+
+	log("[GATEWAY] ", server_udp ? "TCP" : "UDP", " port ", port, " -> ", server_udp ? "UDP " : "TCP ", address_string(server.address));
+
+	return watch(listen_fd, 0, LISTENER, EPOLLIN);
+}
+
+int Gateway::watch(int fd, uint64_t id, Kind kind, uint32_t events) {
+	struct epoll_event event = {};
+
+	event.events = events;
+	event.data.u64 = id << 2 | kind;
+
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0 ? SUCCESS : NETWORK_ERROR;
+}
+
+int Gateway::run() {
+	if (set_signal() || setup()) {
+		return GENERAL_ERROR;
+	}
+
+	struct epoll_event events[64];
+
+	while (!terminate) {
+		int ready = epoll_wait(epoll_fd, events, 64, next_timeout());
+
+		if (ready < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			local_error("epoll_wait() failure");
+			return NETWORK_ERROR;
+		}
+
+		for (int i = 0; i < ready; ++i) {
+			uint64_t id = events[i].data.u64 >> 2;
+			Kind kind = static_cast<Kind>(events[i].data.u64 & 3);
+
+			if (kind == LISTENER) {
+				server_udp ? accept_stream() : receive_listener();
+				continue;
+			}
+
+			auto it = sessions.find(id);
+
+			if (it == sessions.end()) {
+				continue;
+			}
+
+			if (kind == STREAM) {
+				on_stream(*it->second, events[i].events);
+			}
+			else {
+				on_datagram(*it->second);
+			}
+		}
+
+		retransmit();
+		reap();
+	}
+
+	return SUCCESS;
+}
+
+Gateway::Session* Gateway::open_session(int tcp_fd, int udp_fd) {
+	auto session = std::make_unique<Session>();
+	Session* raw = session.get();
+
+	raw->id = next_session++;
+	raw->tcp_fd = tcp_fd;
+	raw->udp_fd = udp_fd;
+	sessions.emplace(raw->id, std::move(session));
+
+	return raw;
+}
+
+/* TCP clients, each one relayed through its own UDP socket */
+void Gateway::accept_stream() {
+	int fd;
+
+	while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		int udp_fd = socket(server.address.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+		if (udp_fd < 0) {
+			close(fd);
+			continue;
+		}
+
+		Session* session = open_session(fd, udp_fd);
+
+		session->tcp_connected = true;
+		session->peer = server.address;
+		session->peer_len = server.length;
+
+		if (watch(fd, session->id, STREAM, EPOLLIN) || watch(udp_fd, session->id, DATAGRAM, EPOLLIN)) {
+			session->failed = true;
+		}
+
+		log("[GATEWAY] session ", session->id, " TCP client");
+	}
+}
+
+/* UDP clients start with AUTH on the listener, the session answers from its own port (dynamic port) */
+void Gateway::receive_listener() {
+	char data[DATAGRAM_MAX];
+	struct sockaddr_storage source;
+	socklen_t source_len = sizeof(source);
+	ssize_t bytes;
+
+	while ((bytes = recvfrom(listen_fd, data, sizeof(data), 0, reinterpret_cast<struct sockaddr*>(&source), &source_len)) >= 0) {
+		std::string key = address_key(source, source_len);
+		auto known = clients.find(key);
+		Session* session = nullptr;
+
+		if (known != clients.end()) {
+			auto it = sessions.find(known->second);
+			session = it != sessions.end() ? it->second.get() : nullptr;
+		}
+		else if (bytes >= 3 && static_cast<uint8_t>(data[0]) == AUTH) {
+			int udp_fd = bind_any(SOCK_DGRAM, 0);
+			int tcp_fd = socket(server.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+			if (udp_fd < 0 || tcp_fd < 0) {
+				close(udp_fd);
+				close(tcp_fd);
+				continue;
+			}
+
+			session = open_session(tcp_fd, udp_fd);
+			session->tcp_writing = true;
+			session->peer = source;
+			session->peer_len = source_len;
+			clients.emplace(key, session->id);
+
+			int result = connect(tcp_fd, reinterpret_cast<const struct sockaddr*>(&server.address), server.length);
+
+			if ((result != 0 && errno != EINPROGRESS)
+				|| watch(tcp_fd, session->id, STREAM, EPOLLIN | EPOLLOUT)
+				|| watch(udp_fd, session->id, DATAGRAM, EPOLLIN)) {
+				session->failed = true;
+			}
+
+			log("[GATEWAY] session ", session->id, " UDP client ", address_string(source));
+		}
+
+		if (session != nullptr && !session->failed) {
+			datagram_to_stream(*session, std::string_view(data, bytes));
+		}
+
+		source_len = sizeof(source);
+	}
+}
+
+void Gateway::on_stream(Session& session, uint32_t events) {
+	/* Server connection completed or refused */
+	if (!session.tcp_connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+		int error = 0;
+		socklen_t length = sizeof(error);
+
+		getsockopt(session.tcp_fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+		if (error != 0) {
+			schema::Message err;
+
+			local_error("Gateway - server unreachable - ", std::strerror(error));
+			err.type = ERR;
+			err.fields[0] = GATEWAY_NAME;
+			err.fields[1] = "Server unreachable";
+			send_datagram(session, err);
+			close_stream(session);
+			return;
+		}
+
+		session.tcp_connected = true;
+	}
+
+	if (events & EPOLLOUT) {
+		flush_stream(session);
+	}
+
+	if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)) || session.tcp_closed) {
+		return;
+	}
+
+	char chunk[DATAGRAM_MAX];
+	ssize_t bytes;
+
+	while ((bytes = read(session.tcp_fd, chunk, sizeof(chunk))) > 0) {
+		session.tcp_in.append(chunk, bytes);
+	}
+
+	bool closed = bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR);
+
+	/* Complete CRLF terminated messages, the ones read before the close too (a final BYE or ERR) */
+	std::size_t used = 0, end;
+
+	while ((end = session.tcp_in.find(CRLF, used)) != std::string::npos) {
+		stream_to_datagram(session, std::string_view(session.tcp_in).substr(used, end - used));
+		used = end + 2;
+	}
+
+	session.tcp_in.erase(0, used);
+
+	if (closed) {
+		close_stream(session);
+	}
+}
+
+void Gateway::on_datagram(Session& session) {
+	char data[DATAGRAM_MAX];
+	struct sockaddr_storage source;
+	socklen_t source_len = sizeof(source);
+	ssize_t bytes;
+
+	while ((bytes = recvfrom(session.udp_fd, data, sizeof(data), 0, reinterpret_cast<struct sockaddr*>(&source), &source_len)) >= 0) {
+		/* The server answers from its dynamic port, a client keeps its address */
+		if (server_udp && same_host(source, session.peer)) {
+			set_port(session.peer, get_port(source));
+		}
+		else if (server_udp || address_key(source, source_len) != address_key(session.peer, session.peer_len)) {
+			source_len = sizeof(source);
+			continue;
+		}
+
+		datagram_to_stream(session, std::string_view(data, bytes));
+		source_len = sizeof(source);
+	}
+}
+
+/* TCP text message -> UDP datagram */
+void Gateway::stream_to_datagram(Session& session, std::string_view line) {
+	schema::Message msg;
+
+	if (session.ending) {
+		return;
+	}
+
+	if (schema::parse<schema::TcpWire>(line, msg)) {
+		schema::Message err;
+
+		local_error("Gateway - malformed TCP message in session ", session.id);
+		err.type = ERR;
+		err.fields[0] = GATEWAY_NAME;
+		err.fields[1] = "Malformed message";
+		send_stream(session, err);
+		session.ending = true;
+		return;
+	}
+
+	/* The REPLY of a TCP server answers the last request of the UDP client */
+	if (msg.type == REPLY) {
+		msg.ref_id = session.request_id;
+	}
+
+	send_datagram(session, msg);
+
+	if (msg.type == BYE || msg.type == ERR) {
+		session.ending = true;
+	}
+}
+
+/* UDP datagram -> TCP text message, confirmed and deduplicated here */
+void Gateway::datagram_to_stream(Session& session, std::string_view data) {
+	schema::Message msg;
+
+	/* Answered like a malformed TCP message, the sender does not retransmit it */
+	if (schema::parse<schema::UdpWire>(data, msg)) {
+		schema::Message err;
+
+		local_error("Gateway - malformed UDP message in session ", session.id);
+
+		if (data.size() >= 3 && static_cast<uint8_t>(data[0]) != CONFIRM) {
+			send_confirm(session, schema::detail::read_u16(data.data() + 1));
+		}
+
+		if (!session.ending) {
+			err.type = ERR;
+			err.fields[0] = GATEWAY_NAME;
+			err.fields[1] = "Malformed message";
+			send_datagram(session, err);
+			session.ending = true;
+		}
+
+		return;
+	}
+
+	if (msg.type == CONFIRM) {
+		if (session.in_flight && schema::detail::read_u16(session.pending.front().data() + 1) == msg.id) {
+			session.pending.pop_front();
+			session.in_flight = false;
+			transmit(session);
+		}
+
+		return;
+	}
+
+	send_confirm(session, msg.id);
+
+	if (session.seen.test(msg.id) || msg.type == PING) {
+		return;
+	}
+
+	session.seen.set(msg.id);
+
+	if (msg.type == AUTH || msg.type == JOIN) {
+		session.request_id = msg.id;
+	}
+
+	send_stream(session, msg);
+
+	if (msg.type == BYE || msg.type == ERR) {
+		session.ending = true;
+	}
+}
+
+void Gateway::send_stream(Session& session, const schema::Message& msg) {
+	std::string line;
+
+	if (session.tcp_closed || !schema::serialize<schema::TcpWire>(line, msg)) {
+		return;
+	}
+
+	session.tcp_out.append(line);
+
+	if (session.tcp_connected) {
+		flush_stream(session);
+	}
+}
+
+/* Queue a datagram, one message is in flight until it is confirmed */
+void Gateway::send_datagram(Session& session, schema::Message& msg) {
+	std::string datagram;
+
+	msg.id = session.next_id++;
+
+	if (schema::serialize<schema::UdpWire>(datagram, msg)) {
+		session.pending.push_back(std::move(datagram));
+		transmit(session);
+	}
+}
+
+void Gateway::send_confirm(Session& session, uint16_t ref_id) {
+	schema::Message confirm;
+	std::string datagram;
+
+	confirm.type = CONFIRM;
+	confirm.id = ref_id;
+	schema::serialize<schema::UdpWire>(datagram, confirm);
+
+	sendto(session.udp_fd, datagram.data(), datagram.size(), 0, reinterpret_cast<const struct sockaddr*>(&session.peer), session.peer_len);
+}
+
+void Gateway::transmit(Session& session) {
+	if (session.in_flight || session.pending.empty()) {
+		return;
+	}
+
+	const std::string& datagram = session.pending.front();
+
+	sendto(session.udp_fd, datagram.data(), datagram.size(), 0, reinterpret_cast<const struct sockaddr*>(&session.peer), session.peer_len);
+
+	session.in_flight = true;
+	session.retries = 0;
+	session.deadline = Clock::now() + confirm_timeout;
+}
+
+void Gateway::flush_stream(Session& session) {
+	while (!session.tcp_out.empty()) {
+		ssize_t bytes = send(session.tcp_fd, session.tcp_out.data(), session.tcp_out.size(), MSG_NOSIGNAL);
+
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if (errno != EAGAIN) {
+				close_stream(session);
+				return;
+			}
+
+			break;
+		}
+
+		session.tcp_out.erase(0, bytes);
+	}
+
+	/* Wait for writability only while something is queued, or until the server connection completes */
+	bool writing = !session.tcp_out.empty() || !session.tcp_connected;
+
+	if (writing != session.tcp_writing) {
+		struct epoll_event event = {};
+
+		event.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+		event.data.u64 = session.id << 2 | STREAM;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session.tcp_fd, &event);
+		session.tcp_writing = writing;
+	}
+}
+
+/* The stream side is done, its socket is closed at once - a level-triggered hangup would wake epoll until the reap */
+void Gateway::close_stream(Session& session) {
+	session.tcp_closed = true;
+	session.ending = true;
+	session.tcp_out.clear();
+
+	if (session.tcp_fd >= 0) {
+		close(session.tcp_fd);
+		session.tcp_fd = -1;
+	}
+}
+
+/* Unconfirmed datagrams are resent, the session fails when the retransmissions run out */
+void Gateway::retransmit() {
+	Clock::time_point now = Clock::now();
+
+	for (auto& [id, session] : sessions) {
+		if (!session->in_flight || now < session->deadline) {
+			continue;
+		}
+
+		if (session->retries >= retransmissions) {
+			log("[GATEWAY] session ", id, " not confirmed");
+			session->failed = true;
+			continue;
+		}
+
+		const std::string& datagram = session->pending.front();
+
+		sendto(session->udp_fd, datagram.data(), datagram.size(), 0, reinterpret_cast<const struct sockaddr*>(&session->peer), session->peer_len);
+
+		session->retries++;
+		session->deadline = now + confirm_timeout;
+	}
+}
+
+/* Milliseconds until the earliest retransmission, -1 when nothing is in flight */
+int Gateway::next_timeout() const {
+	Clock::time_point now = Clock::now();
+	long timeout = -1;
+
+	for (const auto& [id, session] : sessions) {
+		if (session->in_flight) {
+			long left = std::chrono::duration_cast<std::chrono::milliseconds>(session->deadline - now).count();
+
+			timeout = timeout < 0 ? std::max(left, 0L) : std::min(timeout, std::max(left, 0L));
+		}
+	}
+
+	return static_cast<int>(timeout);
+}
+
+/* Drop failed sessions and ended ones with nothing left to deliver */
+void Gateway::reap() {
+	for (auto it = sessions.begin(); it != sessions.end();) {
+		Session& session = *it->second;
+		bool delivered = session.pending.empty() && (session.tcp_out.empty() || session.tcp_closed);
+
+		if (session.failed || (session.ending && delivered)) {
+			log("[GATEWAY] session ", session.id, session.failed ? " failed" : " ended");
+			close_session(session);
+			it = sessions.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void Gateway::close_session(Session& session) {
+	if (!server_udp) {
+		clients.erase(address_key(session.peer, session.peer_len));
+	}
+
+	if (session.tcp_fd >= 0) {
+		close(session.tcp_fd);
+		session.tcp_fd = -1;
+	}
+
+	if (session.udp_fd >= 0) {
+		close(session.udp_fd);
+		session.udp_fd = -1;
+	}
+}
@@ -0,0 +1,114 @@
+/**
+ * @file: gateway.hpp
+ *
+ * TCP <-> UDP gateway, enabled by --gateway <port>.
+ * Local clients speak the other transport than -t on the given port, every client gets its own
+ * server session (-s, -p) over -t. Messages are transcoded wire to wire through the schema
+ * parsers and serializers, the fields stay views into the received data.
+ * The gateway confirms, deduplicates and retransmits on the UDP side by itself (-d, -r).
+ */
+
+#pragma once
+
+#include "config.hpp"
+#include "resolver.hpp"
+#include "schema.hpp"
+
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class Gateway {
+	public:
+		Gateway(const Config& config);
+		~Gateway();
+
+		/* Relay until SIGINT */
+		int run();
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		/* Epoll event owner, packed as id << 2 | kind */
+		enum Kind : uint64_t {
+			STREAM = 0,
+			DATAGRAM = 1,
+			LISTENER = 2
+		};
+
+		struct Session {
+			uint64_t id;
+
+			/* Stream side */
+			int tcp_fd = -1;
+			bool tcp_connected = false; // Server connections complete asynchronously
+			bool tcp_writing = false;   // Registered for EPOLLOUT
+			bool tcp_closed = false;
+			std::string tcp_in, tcp_out;
+
+			/* Datagram side */
+			int udp_fd = -1;
+			struct sockaddr_storage peer;
+			socklen_t peer_len;
+			uint16_t next_id = 0;
+			uint16_t request_id = 0;         // Last AUTH or JOIN of a UDP client, referenced by the REPLY
+			std::bitset<65536> seen;         // Received MessageIDs
+			std::deque<std::string> pending; // Awaiting CONFIRM, the first one is in flight
+			bool in_flight = false;
+			Clock::time_point deadline;
+			int retries = 0;
+
+			/* BYE or ERR relayed, or the stream closed - ends once everything is delivered */
+			bool ending = false;
+			bool failed = false;
+		};
+
+		/* Local clients use TCP and the server UDP, or the other way round */
+		bool server_udp;
+
+		uint16_t port;
+		const char* host;
+		uint16_t server_port;
+		std::chrono::milliseconds confirm_timeout;
+		int retransmissions;
+
+		Endpoint server;
+		int epoll_fd = -1;
+		int listen_fd = -1;
+
+		uint64_t next_session = 1;
+		std::unordered_map<uint64_t, std::unique_ptr<Session>> sessions;
+
+		/* UDP clients by source address, datagrams to the listener are retransmitted AUTHs */
+		std::unordered_map<std::string, uint64_t> clients;
+
+		int setup();
+		int watch(int fd, uint64_t id, Kind kind, uint32_t events);
+
+		void accept_stream();
+		void receive_listener();
+		Session* open_session(int tcp_fd, int udp_fd);
+
+		void on_stream(Session& session, uint32_t events);
+		void on_datagram(Session& session);
+
+		void stream_to_datagram(Session& session, std::string_view line);
+		void datagram_to_stream(Session& session, std::string_view data);
+
+		void send_stream(Session& session, const schema::Message& msg);
+		void send_datagram(Session& session, schema::Message& msg);
+		void send_confirm(Session& session, uint16_t ref_id);
+		void transmit(Session& session);
+		void flush_stream(Session& session);
+		void close_stream(Session& session);
+
+		void retransmit();
+		int next_timeout() const;
+		void reap();
+		void close_session(Session& session);
+};
@@ -0,0 +1,376 @@
+#include "history.hpp"
+#include "error.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/* Record layout: header, channel, name, content, padded to 8 bytes */
+struct RecordHeader {
+	uint32_t length;      // Total record length, 0 marks the end of the segment
+	uint32_t content_len;
+	uint64_t timestamp;
+	uint16_t channel_len;
+	uint16_t name_len;
+	uint8_t direction;
+	uint8_t pad[3];
+};
+
+constexpr std::size_t align8(std::size_t size) {
+	return (size + 7) & ~std::size_t(7);
+}
+
+std::string segment_path(const std::string& dir, uint32_t number) {
+	char name[32];
+
+	std::snprintf(name, sizeof(name), "/seg-%06u", number);
+
+	return dir + name;
+}
+
+/* msync a byte range of a mapping, the start is rounded down to a page */
+void sync_range(char* map, std::size_t from, std::size_t to) {
+	static const std::size_t page = sysconf(_SC_PAGESIZE);
+	std::size_t start = from & ~(page - 1);
+
+	if (to > from) {
+		msync(map + start, to - start, MS_SYNC);
+	}
+}
+
+}
+
+History::History(const std::string& dir)
+	: dir{dir}
+	, segment_fd{-1}
+	, segment{0}
+	, segment_map{nullptr}
+	, tail{0}
+	, index_fd{-1}
+	, index_map{nullptr}
+	, index_capacity{0}
+	, count{0}
+	, synced_tail{0}
+	, synced_count{0}
+	, stop{false} {}
+
+History::~History() {
+	if (committer.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(commit_mutex);
+			stop = true;
+		}
+
+		wakeup.notify_one();
+		committer.join();
+	}
+
+	commit();
+
+	if (segment_map != nullptr) {
+		munmap(segment_map, SEGMENT_SIZE);
+		close(segment_fd);
+	}
+
+	if (index_map != nullptr) {
+		munmap(index_map, index_capacity * sizeof(IndexEntry));
+		close(index_fd);
+	}
+}
+
+std::unique_ptr<History> History::open(const std::string& dir) {
+	std::unique_ptr<History> history(new History(dir));
+
+	mkdir(dir.c_str(), 0755);
+
+	history->index_fd = ::open((dir + "/index").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+	if (history->index_fd < 0 || history->grow_index()) {
+		local_error("Unable to open history index in ", dir);
+		return nullptr;
+	}
+
+	/* Used entries are a prefix of the zero filled index */
+	std::size_t low = 0, high = history->index_capacity;
+
+	while (low < high) {
+		std::size_t mid = (low + high) / 2;
+
+		if (history->index_map[mid].segment != 0) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	history->count = low;
+	history->synced_count = low;
+
+	/* Continue after the last indexed record */
+	uint32_t number = low > 0 ? history->index_map[low - 1].segment : 1;
+
+	if (history->open_segment(number)) {
+		local_error("Unable to open history segment in ", dir);
+		return nullptr;
+	}
+
+	if (low > 0) {
+		const IndexEntry& last = history->index_map[low - 1];
+		auto* header = reinterpret_cast<RecordHeader*>(history->segment_map + last.offset);
+
+		history->tail = last.offset + header->length;
+		history->synced_tail = history->tail;
+	}
+
+	try {
+		history->committer = std::thread(&History::run, history.get());
+	} catch (const std::exception& e) {
+		local_error("History committer - ", e.what());
+		return nullptr;
+	}
+
+	return history;
+}
+
+/* Map a segment as the append target, the previous one is synced and unmapped */
+int History::open_segment(uint32_t number) {
+	int fd = ::open(segment_path(dir, number).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+	if (fd < 0 || ftruncate(fd, SEGMENT_SIZE) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+
+		return GENERAL_ERROR;
+	}
+
+	void* map = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (map == MAP_FAILED) {
+		close(fd);
+		return GENERAL_ERROR;
+	}
+
+	if (segment_map != nullptr) {
+		sync_range(segment_map, synced_tail, tail);
+		munmap(segment_map, SEGMENT_SIZE);
+		close(segment_fd);
+	}
+
+	segment_fd = fd;
+	segment = number;
+	segment_map = static_cast<char*>(map);
+	tail = 0;
+	synced_tail = 0;
+
+	return SUCCESS;
+}
+
+/* Extend the zero filled index by INDEX_CHUNK entries */
+int History::grow_index() {
+	struct stat st;
+
+	if (fstat(index_fd, &st) != 0) {
+		return GENERAL_ERROR;
+	}
+
+	std::size_t capacity = st.st_size / sizeof(IndexEntry);
+
+	if (capacity <= count + 1) {
+		capacity = (count / INDEX_CHUNK + 1) * INDEX_CHUNK;
+
+		if (ftruncate(index_fd, capacity * sizeof(IndexEntry)) != 0) {
+			return GENERAL_ERROR;
+		}
+	}
+
+	void* map = mmap(nullptr, capacity * sizeof(IndexEntry), PROT_READ | PROT_WRITE, MAP_SHARED, index_fd, 0);
+
+	if (map == MAP_FAILED) {
+		return GENERAL_ERROR;
+	}
+
+	if (index_map != nullptr) {
+		sync_range(reinterpret_cast<char*>(index_map), synced_count * sizeof(IndexEntry), count * sizeof(IndexEntry));
+		munmap(index_map, index_capacity * sizeof(IndexEntry));
+		synced_count = count;
+	}
+
+	index_map = static_cast<IndexEntry*>(map);
+	index_capacity = capacity;
+
+	return SUCCESS;
+}
+
+/* Append a record, a copy into the mapped segment and one index entry */
+std::size_t History::append(Direction direction, std::string_view channel, std::string_view name, std::string_view content) {
+	std::size_t length = align8(sizeof(RecordHeader) + channel.length() + name.length() + content.length());
+
+	if (length > SEGMENT_SIZE) {
+		return NONE;
+	}
+
+	/* Roll over to the next segment, or grow the index, while the committer is idle */
+	if (tail + length > SEGMENT_SIZE || count + 1 >= index_capacity) {
+		std::lock_guard<std::mutex> lock(commit_mutex);
+
+		if (tail + length > SEGMENT_SIZE && open_segment(segment + 1)) {
+			local_error("History segment roll failed");
+			return NONE;
+		}
+
+		if (count + 1 >= index_capacity && grow_index()) {
+			local_error("History index growth failed");
+			return NONE;
+		}
+	}
+
+	std::size_t offset = tail;
+	char* out = segment_map + offset;
+	RecordHeader header = {};
+
+	header.length = length;
+	header.content_len = content.length();
+	header.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	header.channel_len = channel.length();
+	header.name_len = name.length();
+	header.direction = static_cast<uint8_t>(direction);
+
+	std::memcpy(out, &header, sizeof(header));
+	out += sizeof(header);
+	std::memcpy(out, channel.data(), channel.length());
+	out += channel.length();
+	std::memcpy(out, name.data(), name.length());
+	out += name.length();
+	std::memcpy(out, content.data(), content.length());
+
+	/* Record first, its index entry makes it visible after a restart */
+	index_map[count] = {segment, static_cast<uint32_t>(offset)};
+
+	tail.store(offset + length, std::memory_order_release);
+
+	return count.fetch_add(1, std::memory_order_release);
+}
+
+History::SegmentView::~SegmentView() {
+	if (map != nullptr) {
+		munmap(map, SEGMENT_SIZE);
+	}
+}
+
+/* Decode a record, older segments are mapped read-only on demand */
+bool History::record_at(std::size_t ordinal, SegmentView& view, Record& record) {
+	const IndexEntry& entry = index_map[ordinal];
+	char* base = segment_map;
+
+	if (entry.segment != segment) {
+		if (entry.segment != view.number) {
+			if (view.map != nullptr) {
+				munmap(view.map, SEGMENT_SIZE);
+				view.map = nullptr;
+				view.number = 0;
+			}
+
+			int fd = ::open(segment_path(dir, entry.segment).c_str(), O_RDONLY | O_CLOEXEC);
+
+			if (fd < 0) {
+				return false;
+			}
+
+			void* map = mmap(nullptr, SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+
+			if (map == MAP_FAILED) {
+				return false;
+			}
+
+			view.map = static_cast<char*>(map);
+			view.number = entry.segment;
+		}
+
+		base = view.map;
+	}
+
+	const auto* header = reinterpret_cast<const RecordHeader*>(base + entry.offset);
+	const char* data = base + entry.offset + sizeof(RecordHeader);
+
+	record.ordinal = ordinal;
+	record.timestamp = header->timestamp;
+	record.direction = static_cast<Direction>(header->direction);
+	record.channel = std::string_view(data, header->channel_len);
+	record.name = std::string_view(data + header->channel_len, header->name_len);
+	record.content = std::string_view(data + header->channel_len + header->name_len, header->content_len);
+
+	return true;
+}
+
+void History::last(std::size_t n, const std::function<void(const Record&)>& visit) {
+	std::size_t end = count;
+
+	range(end > n ? end - n : 0, end, visit);
+}
+
+void History::range(std::size_t begin, std::size_t end, const std::function<void(const Record&)>& visit) {
+	SegmentView view;
+	Record record;
+
+	for (std::size_t i = begin; i < end && i < count; ++i) {
+		if (record_at(i, view, record)) {
+			visit(record);
+		}
+	}
+}
+
+void History::read(const std::vector<std::size_t>& ordinals, const std::function<void(const Record&)>& visit) {
+	SegmentView view;
+	Record record;
+
+	for (std::size_t ordinal : ordinals) {
+		if (ordinal < count && record_at(ordinal, view, record)) {
+			visit(record);
+		}
+	}
+}
+
+std::size_t History::size() const {
+	return count;
+}
+
+const std::string& History::directory() const {
+	return dir;
+}
+
+/* Sync everything appended since the last commit */
+void History::commit() {
+	std::size_t to_tail = tail.load(std::memory_order_acquire);
+	std::size_t to_count = count.load(std::memory_order_acquire);
+
+	if (segment_map != nullptr && to_tail > synced_tail) {
+		sync_range(segment_map, synced_tail, to_tail);
+		synced_tail = to_tail;
+	}
+
+	if (index_map != nullptr && to_count > synced_count) {
+		sync_range(reinterpret_cast<char*>(index_map), synced_count * sizeof(IndexEntry), to_count * sizeof(IndexEntry));
+		synced_count = to_count;
+	}
+}
+
+/* Committer loop, one group commit per interval */
+void History::run() {
+	std::unique_lock<std::mutex> lock(commit_mutex);
+
+	while (!stop) {
+		wakeup.wait_for(lock, std::chrono::milliseconds(COMMIT_INTERVAL));
+		commit();
+	}
+}
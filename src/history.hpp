@@ -0,0 +1,112 @@
+/**
+ * @file: history.hpp
+ *
+ * Append-only chat history store, enabled by --history <dir>.
+ * Records are copied into the memory-mapped tail of fixed-size segment files (seg-NNNNNN),
+ * an offset index (index, 8 bytes per record) locates the last N records without scanning.
+ * Appending never waits for the disk, a committer thread msyncs the dirty ranges every COMMIT_INTERVAL.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class History {
+	public:
+		enum class Direction : uint8_t {
+			INBOUND,
+			OUTBOUND
+		};
+
+		/* Stored record, views into the segment mapping */
+		struct Record {
+			std::size_t ordinal; // Position in the store, starts at 0
+			uint64_t timestamp;  // Realtime clock, nanoseconds
+			Direction direction;
+			std::string_view channel;
+			std::string_view name;
+			std::string_view content;
+		};
+
+		/* Open or create the store in a directory */
+		static std::unique_ptr<History> open(const std::string& dir);
+		~History();
+
+		/* Returns the record ordinal, NONE when the record could not be stored */
+		std::size_t append(Direction direction, std::string_view channel, std::string_view name, std::string_view content);
+
+		/* Visit the last count records, oldest first */
+		void last(std::size_t count, const std::function<void(const Record&)>& visit);
+
+		/* Visit records by ordinal, [begin, end) or an ascending list */
+		void range(std::size_t begin, std::size_t end, const std::function<void(const Record&)>& visit);
+		void read(const std::vector<std::size_t>& ordinals, const std::function<void(const Record&)>& visit);
+
+		std::size_t size() const;
+		const std::string& directory() const;
+
+		static constexpr std::size_t NONE = static_cast<std::size_t>(-1);
+
+	private:
+		/* Segment size, a record never spans two segments */
+		static constexpr std::size_t SEGMENT_SIZE = 8 << 20;
+
+		/* Index growth step, entries */
+		static constexpr std::size_t INDEX_CHUNK = 65536;
+
+		/* Group commit period, milliseconds */
+		static constexpr int COMMIT_INTERVAL = 100;
+
+		struct IndexEntry {
+			uint32_t segment; // Segment number, starts at 1, 0 marks an unused entry
+			uint32_t offset;  // Record offset in the segment
+		};
+
+		/* Read-only mapping of an older segment, kept while consecutive records are read */
+		struct SegmentView {
+			uint32_t number = 0;
+			char* map = nullptr;
+
+			~SegmentView();
+		};
+
+		History(const std::string& dir);
+
+		std::string dir;
+
+		/* Current segment, written by the appender */
+		int segment_fd;
+		uint32_t segment;
+		char* segment_map;
+		std::atomic<std::size_t> tail;
+
+		/* Offset index */
+		int index_fd;
+		IndexEntry* index_map;
+		std::size_t index_capacity;
+		std::atomic<std::size_t> count;
+
+		/* Committer, holds commit_mutex while syncing, segment rolls and index growth take it too */
+		std::mutex commit_mutex;
+		std::condition_variable wakeup;
+		std::thread committer;
+		std::size_t synced_tail;
+		std::size_t synced_count;
+		bool stop;
+
+		int open_segment(uint32_t number);
+		int grow_index();
+		bool record_at(std::size_t ordinal, SegmentView& view, Record& record);
+		void commit();
+		void run();
+};
@@ -0,0 +1,285 @@
+#include "ipk25.h"
+#include "config.hpp"
+#include "error.hpp"
+#include "message.hpp"
+#include "protocol.hpp"
+#include "schema.hpp"
+#include "submit_queue.hpp"
+#include "udp.hpp"
+
+#include <memory>
+#include <poll.h>
+#include <string>
+
+struct ipk25_session {
+	std::string host;
+	std::unique_ptr<Protocol> protocol;
+	UDP* udp; // The protocol of a UDP session, nullptr over TCP
+	std::string display_name;
+
+	ipk25_callback callback;
+	void* user;
+
+	/* Messages of other threads, drained by ipk25_poll */
+	SubmitQueue submitted;
+	std::string outbound;
+
+	/* Last processed message, events point into it */
+	Response response;
+	Response queued;
+};
+
+namespace {
+
+/* Messages handled per ipk25_poll, a flooding server cannot starve the caller's loop */
+constexpr int POLL_BATCH = 64;
+
+void deliver(ipk25_session* session, const Response& response) {
+	ipk25_event event = {};
+
+	switch (response.type) {
+		case REPLY: event.type = IPK25_EVENT_REPLY; break;
+		case MSG:   event.type = IPK25_EVENT_MSG;   break;
+		case ERR:   event.type = IPK25_EVENT_ERR;   break;
+		case BYE:   event.type = IPK25_EVENT_BYE;   break;
+		default:    return;
+	}
+
+	event.ok = response.status == OK;
+	event.display_name = response.dname.data();
+	event.display_name_len = response.dname.length();
+	event.content = response.content.data();
+	event.content_len = response.content.length();
+
+	session->callback(session->user, &event);
+}
+
+/* UDP messages are posted and confirmed from ipk25_poll, a TCP message is written right away */
+int send_message(ipk25_session* session, std::string msg) {
+	if (session->udp == nullptr) {
+		return session->protocol->send(std::move(msg));
+	}
+
+	session->udp->post(std::move(msg));
+
+	return session->udp->transmit();
+}
+
+/* Send submitted messages in order, at most one batch per poll */
+int send_submitted(ipk25_session* session) {
+	session->submitted.reset();
+
+	for (int i = 0; i < POLL_BATCH && session->submitted.pop(session->outbound); ++i) {
+		if (int result = send_message(session, std::move(session->outbound))) {
+			return result;
+		}
+	}
+
+	return SUCCESS;
+}
+
+/* Messages that arrived while a blocking UDP send waited for its CONFIRM */
+void deliver_queued(ipk25_session* session) {
+	auto& msg_queue = session->protocol->get_msg_queue();
+
+	while (msg_queue.pop(session->queued)) {
+		deliver(session, session->queued);
+	}
+}
+
+}
+
+ipk25_session* ipk25_open(const ipk25_options* options, ipk25_callback callback, void* user) {
+	if (options == nullptr || options->host == nullptr || callback == nullptr) {
+		return nullptr;
+	}
+
+	auto session = std::make_unique<ipk25_session>();
+	Config config;
+
+	session->host = options->host;
+	session->display_name = "unknown";
+	session->callback = callback;
+	session->user = user;
+
+	config.protocol = options->transport == IPK25_UDP ? Config::Protocol::UDP : Config::Protocol::TCP;
+	config.ip_hostname = &session->host[0];
+
+	if (options->port != 0) {
+		config.server_port = options->port;
+	}
+
+	if (options->udp_timeout != 0) {
+		config.udp_timeout = options->udp_timeout;
+	}
+
+	if (options->udp_retransmissions != 0) {
+		config.udp_retransmission = options->udp_retransmissions;
+	}
+
+	if (session->submitted.get_fd() == -1 || (session->protocol = Protocol::protocol_setup(config)) == nullptr) {
+		return nullptr;
+	}
+
+	session->udp = config.protocol == Config::Protocol::UDP ? static_cast<UDP*>(session->protocol.get()) : nullptr;
+
+	return session.release();
+}
+
+void ipk25_close(ipk25_session* session) {
+	if (session == nullptr) {
+		return;
+	}
+
+	if (session->protocol->is_connected()) {
+		session->protocol->disconnect(session->display_name);
+	}
+
+	delete session;
+}
+
+int ipk25_fd(ipk25_session* session) {
+	Protocol& protocol = *session->protocol;
+
+	return protocol.is_connected() ? protocol.get_socket() : protocol.connect_fd();
+}
+
+int ipk25_timeout(ipk25_session* session) {
+	Protocol& protocol = *session->protocol;
+
+	if (!protocol.is_connected()) {
+		return protocol.connect_wait();
+	}
+
+	if (protocol.pending() || !protocol.get_msg_queue().empty() || !session->submitted.empty()) {
+		return 0;
+	}
+
+	/* Retransmission of the UDP message in flight */
+	return session->udp != nullptr ? session->udp->next_timeout() : -1;
+}
+
+int ipk25_poll(ipk25_session* session) {
+	Protocol& protocol = *session->protocol;
+
+	if (!protocol.is_connected()) {
+		if (int result = protocol.connect_step()) {
+			return result;
+		}
+
+		if (!protocol.is_connected()) {
+			return SUCCESS;
+		}
+
+		ipk25_event event = {};
+
+		event.type = IPK25_EVENT_CONNECTED;
+		session->callback(session->user, &event);
+	}
+
+	if (int result = send_submitted(session)) {
+		return result;
+	}
+
+	if (session->udp != nullptr) {
+		if (int result = session->udp->retransmit()) {
+			return result;
+		}
+	}
+
+	deliver_queued(session);
+
+	for (int i = 0; i < POLL_BATCH; ++i) {
+		struct pollfd pfd = {protocol.get_socket(), POLLIN, 0};
+		bool buffered = protocol.pending();
+
+		if (!buffered && (protocol.wait(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))) {
+			break;
+		}
+
+		if (!buffered && protocol.receive()) {
+			return NETWORK_ERROR;
+		}
+
+		if (protocol.process(session->response)) {
+			protocol.error(protocol.get_msg_factory().create_err_msg(session->display_name, "Received a malformed message from the server"));
+			return PROTOCOL_ERROR;
+		}
+
+		if (session->response.duplicate || session->response.incomplete) {
+			continue;
+		}
+
+		deliver(session, session->response);
+		deliver_queued(session);
+	}
+
+	/* A CONFIRM received above lets the next posted message go */
+	return session->udp != nullptr ? session->udp->transmit() : SUCCESS;
+}
+
+int ipk25_connected(const ipk25_session* session) {
+	return session->protocol->is_connected();
+}
+
+int ipk25_auth(ipk25_session* session, const char* username, const char* secret, const char* display_name) {
+	if (!schema::valid<AUTH>({username, display_name, secret})) {
+		return MESSAGE_ERROR;
+	}
+
+	if (!session->protocol->is_connected()) {
+		return NETWORK_ERROR;
+	}
+
+	session->display_name = display_name;
+
+	return send_message(session, session->protocol->get_msg_factory().create_auth_msg(username, display_name, secret));
+}
+
+int ipk25_join(ipk25_session* session, const char* channel) {
+	if (!schema::valid(schema::Schema<JOIN>::fields[0], channel)) {
+		return MESSAGE_ERROR;
+	}
+
+	if (!session->protocol->is_connected()) {
+		return NETWORK_ERROR;
+	}
+
+	return send_message(session, session->protocol->get_msg_factory().create_join_msg(channel, session->display_name));
+}
+
+int ipk25_send(ipk25_session* session, const char* content) {
+	if (!schema::valid(schema::Schema<MSG>::fields[1], content)) {
+		return MESSAGE_ERROR;
+	}
+
+	if (!session->protocol->is_connected()) {
+		return NETWORK_ERROR;
+	}
+
+	return send_message(session, session->protocol->get_msg_factory().create_chat_msg(session->display_name, content));
+}
+
+int ipk25_rename(ipk25_session* session, const char* display_name) {
+	if (!schema::valid(schema::Schema<MSG>::fields[0], display_name)) {
+		return MESSAGE_ERROR;
+	}
+
+	session->display_name = display_name;
+
+	return SUCCESS;
+}
+
+int ipk25_submit(ipk25_session* session, const char* display_name, const char* content) {
+	if (!schema::valid<MSG>({display_name, content})) {
+		return MESSAGE_ERROR;
+	}
+
+	session->submitted.push(session->protocol->get_msg_factory().create_chat_msg(display_name, content));
+
+	return SUCCESS;
+}
+
+int ipk25_submit_fd(const ipk25_session* session) {
+	return session->submitted.get_fd();
+}
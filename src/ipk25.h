@@ -0,0 +1,95 @@
+/**
+ * @file: ipk25.h
+ *
+ * libipk25 - IPK25-CHAT client protocol stack with a C API.
+ * Sessions run from the caller's event loop: watch ipk25_fd() for readability, wait at most
+ * ipk25_timeout() milliseconds and call ipk25_poll(), which advances the connection setup and
+ * delivers received messages to the callback. No call blocks except ipk25_close, which waits
+ * for the CONFIRM of a UDP BYE (at most udp_timeout * (udp_retransmissions + 1) milliseconds).
+ * UDP messages are sent one at a time, ipk25_poll sends the next one once the previous is confirmed
+ * and retransmits when ipk25_timeout expires; running out of retransmissions returns a timeout.
+ *
+ * Functions returning int return 0 on success, an error code of the client otherwise.
+ * A session belongs to the thread polling it, only ipk25_submit may be called from others.
+ * Strings of an event are not NUL terminated, they are valid until the callback returns
+ * or calls into the session.
+ */
+
+#ifndef IPK25_H
+#define IPK25_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ipk25_session ipk25_session;
+
+typedef enum {
+	IPK25_TCP,
+	IPK25_UDP
+} ipk25_transport;
+
+typedef enum {
+	IPK25_EVENT_CONNECTED, /* Connection set up, requests can be sent */
+	IPK25_EVENT_REPLY,     /* Answer to AUTH or JOIN, ok is set on success */
+	IPK25_EVENT_MSG,
+	IPK25_EVENT_ERR,
+	IPK25_EVENT_BYE
+} ipk25_event_type;
+
+typedef struct {
+	ipk25_event_type type;
+	int ok;
+	const char* display_name;
+	size_t display_name_len;
+	const char* content;
+	size_t content_len;
+} ipk25_event;
+
+typedef void (*ipk25_callback)(void* user, const ipk25_event* event);
+
+typedef struct {
+	ipk25_transport transport;
+	const char* host;            /* Address, hostname or unix:path */
+	uint16_t port;               /* 0 selects 4567 */
+	uint16_t udp_timeout;        /* Milliseconds, 0 selects 250 */
+	uint8_t udp_retransmissions; /* 0 selects 3 */
+} ipk25_options;
+
+/* Start connecting, NULL on failure */
+ipk25_session* ipk25_open(const ipk25_options* options, ipk25_callback callback, void* user);
+
+/* Say BYE when connected and release the session, messages not yet sent are dropped */
+void ipk25_close(ipk25_session* session);
+
+/* Descriptor to watch for readability, it may change with every ipk25_poll */
+int ipk25_fd(ipk25_session* session);
+
+/* Milliseconds until ipk25_poll is due even without readability, -1 for none */
+int ipk25_timeout(ipk25_session* session);
+
+/* Advance the connection setup and deliver received messages */
+int ipk25_poll(ipk25_session* session);
+
+int ipk25_connected(const ipk25_session* session);
+
+/* Requests, the REPLY arrives as an event; the display name is kept for later messages */
+int ipk25_auth(ipk25_session* session, const char* username, const char* secret, const char* display_name);
+int ipk25_join(ipk25_session* session, const char* channel);
+int ipk25_send(ipk25_session* session, const char* content);
+int ipk25_rename(ipk25_session* session, const char* display_name);
+
+/* Lock-free chat message submission from any thread, sent in order by ipk25_poll once connected */
+int ipk25_submit(ipk25_session* session, const char* display_name, const char* content);
+
+/* Descriptor readable when messages were submitted, to watch next to ipk25_fd */
+int ipk25_submit_fd(const ipk25_session* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
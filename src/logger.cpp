@@ -0,0 +1,133 @@
+#include "logger.hpp"
+
+#include <condition_variable>
+#include <cstdlib>
+#include <fcntl.h>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+/* Background flusher - owns the log file descriptor and the pending records */
+class Flusher {
+	public:
+		Flusher() : fd{STDERR_FILENO}, stop{false}, writing{false} {
+			const char* path = std::getenv("IPK25_LOG_FILE");
+
+			if (path != nullptr) {
+				int file = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+				if (file >= 0) {
+					fd = file;
+				}
+			}
+
+			thread = std::thread(&Flusher::run, this);
+		}
+
+		/* Writes the remaining records on exit */
+		~Flusher() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+
+			ready.notify_one();
+			thread.join();
+
+			if (fd != STDERR_FILENO) {
+				close(fd);
+			}
+		}
+
+		void submit(const std::string& record) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending.append(record);
+			}
+
+			ready.notify_one();
+		}
+
+		void flush() {
+			std::unique_lock<std::mutex> lock(mutex);
+
+			drained.wait(lock, [this] { return pending.empty() && !writing; });
+		}
+
+	private:
+		int fd;
+		bool stop;
+		bool writing;
+
+		std::string pending; // Records waiting for the flusher
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::condition_variable drained;
+		std::thread thread;
+
+		/* Flusher loop, writes pending records in batches */
+		void run() {
+			std::string batch;
+			std::unique_lock<std::mutex> lock(mutex);
+
+			while (true) {
+				ready.wait(lock, [this] { return stop || !pending.empty(); });
+
+				if (pending.empty()) {
+					break; // Stopped and drained
+				}
+
+				batch.swap(pending);
+				writing = true;
+
+				lock.unlock();
+				write_batch(batch);
+				batch.clear();
+				lock.lock();
+
+				writing = false;
+				drained.notify_all();
+			}
+		}
+
+		void write_batch(const std::string& batch) {
+			const char* data = batch.data();
+			std::size_t len = batch.length();
+
+			while (len > 0) {
+				ssize_t n = ::write(fd, data, len);
+
+				if (n < 0) {
+					return; // Nowhere to report a logging failure
+				}
+
+				data += n;
+				len -= n;
+			}
+		}
+};
+
+/* Started on the first record */
+Flusher& flusher() {
+	static Flusher instance;
+
+	return instance;
+}
+
+}
+
+std::string& logger::record_buffer() {
+	thread_local std::string record;
+
+	return record;
+}
+
+void logger::submit(const std::string& record) {
+	flusher().submit(record);
+}
+
+void logger::flush() {
+	flusher().flush();
+}
@@ -0,0 +1,70 @@
+/**
+ * @file: logger.hpp
+ *
+ * Asynchronous logger. Records are formatted into a thread-local buffer and handed
+ * to a background flusher thread, which writes them to the log file descriptor.
+ * Levels below IPK25_LOG_LEVEL are removed at compile time, `make LOG_LEVEL=0` enables debug logs.
+ * Log output goes to stderr, or is appended to the file given by the IPK25_LOG_FILE environment variable.
+ */
+
+#pragma once
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/* Default level - errors and info, debug records compiled out */
+#ifndef IPK25_LOG_LEVEL
+#define IPK25_LOG_LEVEL 1
+#endif
+
+namespace logger {
+	enum class Level : int {
+		DEBUG = 0,
+		INFO = 1,
+		ERROR = 2
+	};
+
+	inline constexpr int LEVEL = IPK25_LOG_LEVEL;
+
+	/* Thread-local record buffer */
+	std::string& record_buffer();
+
+	/* Queue a finished record for the flusher thread */
+	void submit(const std::string& record);
+
+	/* Block until all queued records are written */
+	void flush();
+
+	/* Record formatting */
+	inline void append(std::string& record, std::string_view value) {
+		record.append(value);
+	}
+
+	inline void append(std::string& record, char value) {
+		record.push_back(value);
+	}
+
+	template <class T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>, int> = 0>
+	inline void append(std::string& record, T value) {
+		char digits[24];
+		auto result = std::to_chars(digits, digits + sizeof(digits), +value);
+
+		record.append(digits, result.ptr - digits);
+	}
+
+	/* Format and queue a record, compiled out below the configured level */
+	template <Level L, class... Args>
+	inline void write(std::string_view prefix, const Args&... args) {
+		if constexpr (static_cast<int>(L) >= LEVEL) {
+			std::string& record = record_buffer();
+
+			record.assign(prefix);
+			(append(record, args), ...);
+			record.push_back('\n');
+
+			submit(record);
+		}
+	}
+}
@@ -1,9 +1,21 @@
 #include "error.hpp"
+#include "alloc_stats.hpp"
+#include "logger.hpp"
 #include "args.hpp"
+#include "recorder.hpp"
 #include "config.hpp"
 #include "client.hpp"
+#include "history.hpp"
+#include "rules.hpp"
+#include "daemon.hpp"
+#include "gateway.hpp"
+#include "tcp.hpp"
+#include "udp.hpp"
 #include "error.hpp"
 
+#include <pthread.h>
+#include <sched.h>
+
 /* TODO:
  * incomming message queue
  * Proper ERR messages sending
@@ -16,27 +28,95 @@
 int main(int argc, char **argv) {
 	Config config;
 
+	/* Flight recorder dump handlers */
+	if (recorder::install()) {
+		return GENERAL_ERROR;
+	}
+
 	/* Parse program parameters */
 	if (args_parse(argc, argv, config)) {
 		local_error("Argument parsing failed");
 		return PARSE_ERROR;
 	}
 
+	/* Gateway mode relays other clients, there is no session of its own */
+	if (config.gateway_port != 0) {
+		Gateway gateway(config);
+
+		return gateway.run() ? CLIENT_ERROR : 0;
+	}
+
 	/* Select and setup given protocol */
 	auto protocol = Protocol::protocol_setup(config);
 
 	if (protocol == nullptr) {
 		local_error("Protocol setup failed");
+		recorder::dump();
 		return PROTOCOL_ERROR;
 	}
 
+	/* History committer is started before pinning, it keeps off the I/O CPU */
+	std::unique_ptr<History> history;
+
+	if (config.history_dir != nullptr && (history = History::open(config.history_dir)) == nullptr) {
+		local_error("History store setup failed");
+		return GENERAL_ERROR;
+	}
+
+	std::unique_ptr<RuleEngine> rules;
+
+	if (config.rules_file != nullptr && (rules = RuleEngine::load(config.rules_file)) == nullptr) {
+		local_error("Rule engine setup failed");
+		return GENERAL_ERROR;
+	}
+
+	std::unique_ptr<Daemon> api;
+
+	if (config.daemon_path != nullptr && (api = Daemon::listen(config.daemon_path)) == nullptr) {
+		local_error("Daemon setup failed");
+		return GENERAL_ERROR;
+	}
+
+	/* Pin the I/O thread, the logger is started first so that helper threads keep their affinity */
+	if (config.cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(config.cpu, &set);
+		logger::flush();
+
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+			local_error("Unable to pin to CPU ", config.cpu);
+			return GENERAL_ERROR;
+		}
+	}
+
 	/* Launch and run client */
 	Client client(std::move(protocol));
 
-	if (client.client_run()) {
+	client.set_history(std::move(history));
+	client.set_rules(std::move(rules));
+	client.set_daemon(std::move(api));
+	client.set_reconnect(config.reconnect_ms);
+
+	/* Transport is fixed for the whole session, select the client loop once */
+#ifdef IPK25_DYNAMIC_DISPATCH
+	int result = client.client_run<Protocol>();
+#else
+	int result = config.protocol == Config::Protocol::TCP ? client.client_run<TCP>() : client.client_run<UDP>();
+#endif
+
+	if (result) {
 			local_error("Client runtime");
+			recorder::dump();
+			alloc_stats::report();
 			return CLIENT_ERROR;
 	}
 
+	/* Allocation accounting builds fail when over the allocation budget */
+	if (alloc_stats::report()) {
+		return GENERAL_ERROR;
+	}
+
 	return 0;
 }
\ No newline at end of file
@@ -1,51 +1,24 @@
 #include "message.hpp"
+#include "schema.hpp"
+
+#include <ostream>
 
 /**
- *	Message validation helper functions
+ *	Message validation helper functions, character classes are defined by the message schema
  */
-bool valid_char(std::string string) {
-	char c;
-
-	for (int i = 0; i < string.length(); ++i) {
-		c = string[i];
-
-		/* Alphanumeric chars, underscore, dash */
-		if (!isalnum(c) && c != '_' && c != '-') {
-			return false;
-		}
-	}
-
-	return true;
+bool valid_char(std::string_view string) {
+	/* Alphanumeric chars, underscore, dash */
+	return schema::valid_chars(schema::Charset::ID, string);
 }
 
-bool valid_printable(std::string string) {
-	char c;
-
-	for (int i = 0; i < string.length(); ++i) {
-		c = string[i];
-
-		/* Printable ASCII chars from ! to ~ */
-		if (c < 0x21 || c > 0x7E) {
-			return false;
-		}
-	}
-
-	return true;	
+bool valid_printable(std::string_view string) {
+	/* Printable ASCII chars from ! to ~ */
+	return schema::valid_chars(schema::Charset::PRINTABLE, string);
 }
 
-bool valid_printable_msg(std::string string) {
-	char c;
-
-	for (int i = 0; i < string.length(); ++i) {
-		c = string[i];
-
-		/* Printable ASCII chars from ! to ~, space, linefeed */
-		if ((c < 0x20 || c > 0x7E) && c != 0x0A) {
-			return false;
-		}
-	}
-
-	return true;	
+bool valid_printable_msg(std::string_view string) {
+	/* Printable ASCII chars from ! to ~, space, linefeed */
+	return schema::valid_chars(schema::Charset::CONTENT, string);
 }
 
 
@@ -67,4 +40,53 @@ std::string str_up(std::string str) {
 	}
 
 	return str;
+}
+
+/* Case insensitive comparison */
+bool iequals(std::string_view a, std::string_view b) {
+	if (a.length() != b.length()) {
+		return false;
+	}
+
+	for (std::size_t i = 0; i < a.length(); ++i) {
+		if (to_upper(a[i]) != to_upper(b[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Message type name, used by diagnostics */
+const char* msg_type_name(uint8_t type) {
+	switch (type) {
+		case CONFIRM: return "CONFIRM";
+		case REPLY:   return "REPLY";
+		case AUTH:    return "AUTH";
+		case JOIN:    return "JOIN";
+		case MSG:     return "MSG";
+		case PING:    return "PING";
+		case ERR:     return "ERR";
+		case BYE:     return "BYE";
+		default:      return "UNKNOWN";
+	}
+}
+
+/**
+ *	Response output formatting
+ */
+std::ostream& operator<<(std::ostream& os, const Response& response) {
+	switch (response.type) {
+		case MSG:
+			return os << response.dname << ": " << response.content;
+
+		case ERR:
+			return os << "ERROR FROM " << response.dname << ": " << response.content;
+
+		case REPLY:
+			return os << (response.status == OK ? "Action Success: " : "Action Failure: ") << response.content;
+
+		default:
+			return os;
+	}
 }
\ No newline at end of file
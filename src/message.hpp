@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <iosfwd>
 #include <string>
+#include <string_view>
 
 /* Message type */
 enum MsgType : uint8_t {
@@ -23,15 +25,25 @@ enum ResponseStatus : uint8_t {
 	NOK    // NOT OK
 };
 
-/* Response message container struct */
+/* Response message container struct
+ *
+ * Parsed fields are views into the protocol receive buffer, valid until the next receive.
+ * A response kept for later (message queue) holds the fields in its own storage.
+ * Formatting for the user happens only on output, see operator<<.
+ */
 struct Response {
 	MsgType type = UNKNOWN;       // Message type
 	ResponseStatus status = NONE; // Response status, if it has any
-	std::string content;          // Formated content of the message
+	std::string_view dname;       // Display name (MSG, ERR, BYE)
+	std::string_view content;     // Content of the message (MSG, ERR, REPLY)
+	std::string storage;          // Owned backing store of dname and content
 	bool duplicate = false;       // Flag for duplicate message
 	bool incomplete = false;      // Flag for incomplete message when segmentation occurrs
 };
 
+/* Response output formatting */
+std::ostream& operator<<(std::ostream& os, const Response& response);
+
 /* Maximum length of parameters */
 inline constexpr int MAX_ID_LEN = 20;      // Username - 20 bytes
 inline constexpr int MAX_CID_LEN = 20;     // Channel ID - 20 bytes
@@ -43,10 +55,12 @@ inline constexpr int MAX_MSG_LEN = 60000;  // Message - 60 000 bytes
 constexpr const char* CRLF = "\r\n";
 
 /* Message validation helper functions */
-bool valid_char(std::string string);
-bool valid_printable(std::string string);
-bool valid_printable_msg(std::string string);
+bool valid_char(std::string_view string);
+bool valid_printable(std::string_view string);
+bool valid_printable_msg(std::string_view string);
 
 /* Message conversion helper functions */
 char to_upper(char c);
-std::string str_up(std::string str);
\ No newline at end of file
+std::string str_up(std::string str);
+bool iequals(std::string_view a, std::string_view b);
+const char* msg_type_name(uint8_t type);
\ No newline at end of file
@@ -1,88 +1,80 @@
 #include "msg_factory.hpp"
 #include "message.hpp"
-#include <cstdint>
+#include "schema.hpp"
+
+/**
+ *	Messages are serialized from the declarative message schema (schema.hpp),
+ *	the same field description generates both wire formats.
+ *
+ *	UDP messages have the MessageID set only when sending,
+ *	for now it has a default value of zero.
+ */
+
+/* Serialize message of type T in the given wire format */
+template <MsgType T, class Wire>
+std::string create_msg(std::string_view f0 = {}, std::string_view f1 = {}, std::string_view f2 = {}) {
+	schema::Message msg {T, NONE, 0, 0, {f0, f1, f2}};
+	std::string out;
+
+	schema::serialize<T, Wire>(out, msg);
+
+	return out;
+}
 
 /**
  *	TCP Messages
  */
 
 /* TCP AUTH message */
-std::string TCPMsgFactory::create_auth_msg(std::string id, std::string dname, std::string secret) const {
-	return "AUTH " + id + " AS " + dname + " USING " + secret + CRLF;
+std::string TCPMsgFactory::create_auth_msg(std::string_view id, std::string_view dname, std::string_view secret) const {
+	return create_msg<AUTH, schema::TcpWire>(id, dname, secret);
 }
 
 /* TCP JOIN message */
-std::string TCPMsgFactory::create_join_msg(std::string id, std::string dname) const {
-	return "JOIN " + id + " AS " + dname + CRLF;
+std::string TCPMsgFactory::create_join_msg(std::string_view id, std::string_view dname) const {
+	return create_msg<JOIN, schema::TcpWire>(id, dname);
 }
 
 /* TCP MSG message */
-std::string TCPMsgFactory::create_chat_msg(std::string dname, std::string msg) const {
-	return "MSG FROM " + dname + " IS " + msg + CRLF;
+std::string TCPMsgFactory::create_chat_msg(std::string_view dname, std::string_view msg) const {
+	return create_msg<MSG, schema::TcpWire>(dname, msg);
 }
 
 /* TCP ERR message */
-std::string TCPMsgFactory::create_err_msg(std::string dname, std::string msg) const {
-	return "ERR FROM " + dname + " IS " + msg + CRLF;
+std::string TCPMsgFactory::create_err_msg(std::string_view dname, std::string_view msg) const {
+	return create_msg<ERR, schema::TcpWire>(dname, msg);
 }
 
 /* TCP BYE message */
-std::string TCPMsgFactory::create_bye_msg(std::string dname) const {
-	return "BYE FROM " + dname + CRLF;
+std::string TCPMsgFactory::create_bye_msg(std::string_view dname) const {
+	return create_msg<BYE, schema::TcpWire>(dname);
 }
 
 /**
  *	UDP Messages
  */
 
-/* UDP message serializer
- *
- * The serializer formats the IPK25 protocol message for the UDP transport layer protocol.
- * It is important to note that the MessageID is only set when sending,
- * for now it has a default value of zero.
- *
- *  1 byte       2 bytes           n bytes
- * +--------+--------+--------+-------~~------+---+
- * |  0x04  |    MessageID    |    Content    | 0 |
- * +--------+--------+--------+-------~~------+---+
- */
-std::string udp_serialize(uint8_t msg_type, std::string content) {
-	std::string msg = std::string(1, msg_type) + std::string(2, 0x00) + content;
-
-	return msg;
-}
-
 /* UDP AUTH message */
-std::string UDPMsgFactory::create_auth_msg(std::string id, std::string dname, std::string secret) const {
-	std::string content = id + '\0' + dname + '\0' + secret + '\0';
-
-	return udp_serialize(MsgType::AUTH, content);
+std::string UDPMsgFactory::create_auth_msg(std::string_view id, std::string_view dname, std::string_view secret) const {
+	return create_msg<AUTH, schema::UdpWire>(id, dname, secret);
 }
 
 /* UDP JOIN message */
-std::string UDPMsgFactory::create_join_msg(std::string id, std::string dname) const {
-	std::string content = id + '\0' + dname + '\0';
-
-	return udp_serialize(MsgType::JOIN, content);
+std::string UDPMsgFactory::create_join_msg(std::string_view id, std::string_view dname) const {
+	return create_msg<JOIN, schema::UdpWire>(id, dname);
 }
 
 /* UDP MSG message */
-std::string UDPMsgFactory::create_chat_msg(std::string dname, std::string msg) const {
-	std::string content = dname + '\0' + msg + '\0';
-
-	return udp_serialize(MsgType::MSG, content);
+std::string UDPMsgFactory::create_chat_msg(std::string_view dname, std::string_view msg) const {
+	return create_msg<MSG, schema::UdpWire>(dname, msg);
 }
 
 /* UDP ERR message */
-std::string UDPMsgFactory::create_err_msg(std::string dname, std::string msg) const {
-	std::string content = dname + '\0' + msg + '\0';
-
-	return udp_serialize(MsgType::ERR, content);
+std::string UDPMsgFactory::create_err_msg(std::string_view dname, std::string_view msg) const {
+	return create_msg<ERR, schema::UdpWire>(dname, msg);
 }
 
 /* UDP BYE message */
-std::string UDPMsgFactory::create_bye_msg(std::string dname) const {
-	std::string content = dname + '\0';
-
-	return udp_serialize(MsgType::BYE, content);
+std::string UDPMsgFactory::create_bye_msg(std::string_view dname) const {
+	return create_msg<BYE, schema::UdpWire>(dname);
 }
\ No newline at end of file
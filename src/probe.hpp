@@ -0,0 +1,29 @@
+/**
+ * @file: probe.hpp
+ *
+ * Static tracepoints (USDT) for perf and bpftrace, compiled in by default whenever <sys/sdt.h>
+ * (systemtap-sdt-dev) is available, so production builds can be traced without a rebuild.
+ * An inactive probe is a single nop, `make USDT=0` leaves them out entirely.
+ *
+ * Provider "ipk25", three unsigned arguments per probe. Message probes carry (message type, size, message ID):
+ *   udp_receive                 type byte, datagram size, message ID (UNKNOWN and 0 below 3 bytes)
+ *   tcp_process, udp_process    parsed type, message size, server message ID (0 over TCP, it has none)
+ *   udp_retransmit              type, message size, client message ID
+ *   process_msg                 type, content size, 0
+ * The others are not about one message and have their own layouts:
+ *   tcp_receive                 bytes read, bytes buffered after the read, 0 (a read may hold parts of several messages)
+ *   await_enter                 expected type, timeout in ms, 0
+ *   await_exit                  type of the last received message, result code (error.hpp), 0
+ *
+ * Example: bpftrace -e 'usdt:./ipk25chat-client:ipk25:udp_retransmit { @[arg0] = count(); }'
+ */
+
+#pragma once
+
+#if !defined(IPK25_NO_USDT) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+
+#define PROBE(name, arg0, arg1, arg2) DTRACE_PROBE3(ipk25, name, (unsigned) (arg0), (unsigned) (arg1), (unsigned) (arg2))
+#else
+#define PROBE(name, arg0, arg1, arg2) ((void) 0)
+#endif
@@ -2,10 +2,13 @@
 #include "tcp.hpp"
 #include "udp.hpp"
 #include "error.hpp"
+#include "probe.hpp"
 #include "config.hpp"
 #include "message.hpp"
 #include "msg_factory.hpp"
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -18,12 +21,14 @@
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 
 /* Generic transport protocol constructor  */
-Protocol::Protocol(Config& config) : protocol_type{config.protocol}, socket_fd{-1}, dyn_port{config.server_port},
-	b_rx{0} {
+Protocol::Protocol(Config& config) : protocol_type{config.protocol}, socket_fd{-1}, server_address_len{0},
+	dyn_port{config.server_port}, low_latency{config.low_latency}, spin_us{config.spin_us}, b_rx{0} {
 	if (protocol_type == Config::Protocol::TCP) {
 		socket_type = SOCK_STREAM;
 	}
@@ -37,7 +42,9 @@ Protocol::Protocol(Config& config) : protocol_type{config.protocol}, socket_fd{-
 
 /* Transport protocol destructor - closes socket */
 Protocol::~Protocol() {
-	close(socket_fd);
+	if (socket_fd >= 0) {
+		close(socket_fd);
+	}
 }
 
 /* Static protocol setup function */
@@ -64,16 +71,24 @@ std::unique_ptr<Protocol> Protocol::protocol_setup(Config& config) {
 				break;
 		}
 	} catch (const std::exception& e) {
-		local_error(std::string("Caught memory exception - ") + e.what());
+		local_error("Caught memory exception - ", e.what());
 		return nullptr;
 	}
 
-	if (protocol->create_socket() != 0) {
-		local_error("Failed to create a socket");
+	/* Resolution runs in the background, the client keeps reading input meanwhile */
+	protocol->connect_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(protocol->timeout);
+
+	/* io_uring backend, system calls when the kernel lacks the required features */
+	if (config.io_uring && (protocol->uring = Uring::create()) == nullptr) {
+		log("io_uring unavailable, using system calls");
+	}
+
+	if (protocol->resolver.start(config.ip_hostname, config.server_port, protocol->socket_type) != 0) {
+		local_error("Failed to retrieve server address");
 		return nullptr;
 	}
 
-	if (protocol->get_address(config.ip_hostname) != 0) {
+	if (!protocol->resolver.pending() && protocol->resolved() != 0) {
 		local_error("Failed to retrieve server address");
 		return nullptr;
 	}
@@ -87,14 +102,14 @@ MsgFactory& Protocol::get_msg_factory() {
 }
 
 /* Getter function - returns ref to msg_queue */
-std::queue<Response>& Protocol::get_msg_queue() {
+ResponseQueue& Protocol::get_msg_queue() {
 	return msg_queue;
 }
 
-/* Create a non-blocking socket */
-int Protocol::create_socket() {
+/* Open a non-blocking socket */
+int Protocol::open_socket(int family) {
 	/* Create socket */
-	int fd = socket(AF_INET, socket_type, 0);
+	int fd = socket(family, socket_type, 0);
 
 	if (fd < 0) {
 		local_error("socket()");
@@ -110,35 +125,240 @@ int Protocol::create_socket() {
 		return -1;
 	}
 
-	socket_fd  = fd;
+	/* Unix datagram replies need a client address, bind to an autogenerated abstract name */
+	if (family == AF_UNIX && socket_type == SOCK_DGRAM) {
+		struct sockaddr_un local = {};
 
-	return 0;
+		local.sun_family = AF_UNIX;
+
+		if (bind(fd, (struct sockaddr *) &local, sizeof(sa_family_t)) != 0) {
+			close(fd);
+			local_error("bind()");
+			return -1;
+		}
+	}
+
+	if (low_latency) {
+		tune_socket(fd, family);
+	}
+
+	return fd;
 }
 
-/* Get server (host) IPv4 sockaddr_in address */
-int Protocol::get_address(const char* ip_hname) {
-	struct addrinfo *addrinfo, hints{};
+/* Latency profile socket options, failures only lose the tuning */
+void Protocol::tune_socket(int fd, int family) {
+	int nodelay = 1;
+	int busy_poll = spin_us > 0 ? spin_us : BUSY_POLL;
+	int buffer_size = SOCKET_BUFFER;
 
-	/* IPv4 and protocol filter */
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = socket_type;
+	/* Small messages leave without waiting for ACKs (Nagle) */
+	if (socket_type == SOCK_STREAM && family != AF_UNIX && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) != 0) {
+		log("TCP_NODELAY failed: ", errno);
+	}
 
-	/* Get address information */
-	if (getaddrinfo(ip_hname, std::to_string(dyn_port).c_str(), &hints, &addrinfo) != 0) {
-		local_error(std::string("Unable to get host (") + std::string(ip_hname) + ") address information");
-		return 1;
+	/* Blocking receives busy-poll the device queue, may need CAP_NET_ADMIN */
+	if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) != 0) {
+		log("SO_BUSY_POLL failed: ", errno);
 	}
 
-	server_address = *reinterpret_cast<struct sockaddr_in*>(addrinfo->ai_addr);
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)) != 0
+		|| setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size)) != 0) {
+		log("Socket buffer size failed: ", errno);
+	}
+}
 
-	freeaddrinfo(addrinfo);
+/* poll() wrapper, spins with non-blocking polls for the busy-poll budget before blocking */
+int Protocol::wait(struct pollfd* pfds, unsigned count, int timeout) {
+	if (spin_us > 0 && timeout != 0) {
+		auto start = std::chrono::steady_clock::now();
+		auto budget = std::chrono::microseconds(spin_us);
+
+		do {
+			int ready = poll(pfds, count, 0);
+
+			if (ready != 0) {
+				return ready;
+			}
+		} while (std::chrono::steady_clock::now() - start < budget);
+
+		if (timeout > 0) {
+			timeout = std::max<int>(0, timeout - spin_us / 1000);
+		}
+	}
+
+	return poll(pfds, count, timeout);
+}
+
+/* Create the protocol socket, replacing the previous one */
+int Protocol::create_socket(int family) {
+	int fd = open_socket(family);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (socket_fd >= 0) {
+		/* The posted receive holds a reference to the old socket */
+		if (uring != nullptr) {
+			uring->disarm();
+		}
+
+		close(socket_fd);
+	}
+
+	socket_fd = fd;
+
+	if (uring != nullptr && connected && uring->arm(socket_fd, socket_type == SOCK_DGRAM)) {
+		return -1;
+	}
 
 	return 0;
 }
 
-/* Getter function - returns socket */
+/* Take over the resolved addresses, UDP needs its socket before the first send */
+int Protocol::resolved() {
+	if (resolver.result(endpoints)) {
+		return ADDRESS_ERROR;
+	}
+
+	server_address = endpoints.front().address;
+	server_address_len = endpoints.front().length;
+
+	/* TCP opens its sockets when racing the connection attempts */
+	if (protocol_type == Config::Protocol::UDP && create_socket(server_address.ss_family) != 0) {
+		local_error("Failed to create a socket");
+		return NETWORK_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+/* Pollable descriptor of the pending connection setup, -1 when there is nothing to wait for */
+int Protocol::connect_fd() {
+	return resolver.pending() ? resolver.get_fd() : handshake_fd();
+}
+
+/* Milliseconds left for the connection setup */
+int Protocol::connect_wait() {
+	auto left = std::chrono::duration_cast<std::chrono::milliseconds>(connect_deadline - std::chrono::steady_clock::now());
+
+	return left.count() > 0 ? left.count() : 0;
+}
+
+/* Advance the connection setup, is_connected() reports completion */
+int Protocol::connect_step() {
+	if (resolver.pending()) {
+		if (std::chrono::steady_clock::now() >= connect_deadline) {
+			local_error("Server name resolution timeout");
+			return TIMEOUT;
+		}
+
+		return SUCCESS;
+	}
+
+	if (endpoints.empty() && resolved()) {
+		return ADDRESS_ERROR;
+	}
+
+	int result;
+
+	/* Handshake gets its own deadline */
+	if (!handshake) {
+		handshake = true;
+		connect_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		result = connect();
+	}
+	else {
+		result = connect_poll();
+	}
+
+	if (result == SUCCESS && !connected && std::chrono::steady_clock::now() >= connect_deadline) {
+		local_error("Connection timeout");
+		result = TIMEOUT;
+	}
+
+	if (result) {
+		/* Cached addresses may be stale */
+		resolver.forget();
+	}
+	else if (connected && uring != nullptr && uring->arm(socket_fd, socket_type == SOCK_DGRAM)) {
+		local_error("io_uring receive");
+		result = NETWORK_ERROR;
+	}
+
+	return result;
+}
+
+/* Connection lost, the client loop steps the setup again without resolving the server anew */
+int Protocol::reconnect() {
+	if (endpoints.empty()) {
+		return ADDRESS_ERROR;
+	}
+
+	/* The posted receive holds a reference to the old socket */
+	if (uring != nullptr) {
+		uring->disarm();
+	}
+
+	connected = false;
+	handshake = false;
+	b_rx = 0;
+
+	return reset();
+}
+
+/* Datagrams carry exactly one message */
+bool Protocol::pending() {
+	return false;
+}
+
+/* Handshake in flight, protocols with a connection override these */
+int Protocol::connect_poll() {
+	return SUCCESS;
+}
+
+int Protocol::handshake_fd() {
+	return -1;
+}
+
+bool Protocol::is_connected() const {
+	return connected;
+}
+
+/* Getter function - returns the descriptor polled for incoming messages */
 int Protocol::get_socket() {
-	return socket_fd;
+	return uring != nullptr ? uring->get_fd() : socket_fd;
+}
+
+uint16_t Protocol::get_timeout() const {
+	return timeout;
+}
+
+/* Send a message, dst is the datagram destination or nullptr on a connected socket */
+ssize_t Protocol::io_send(const std::string& msg, const struct sockaddr* dst, socklen_t dst_len) {
+	if (uring != nullptr) {
+		return uring->send(socket_fd, msg.data(), msg.length(), dst, dst_len);
+	}
+
+	/* A closed connection is reported by the return value, not by SIGPIPE */
+	if (dst == nullptr) {
+		return ::send(socket_fd, msg.data(), msg.length(), MSG_NOSIGNAL);
+	}
+
+	return sendto(socket_fd, msg.data(), msg.length(), 0, dst, dst_len);
+}
+
+/* Receive a message, the datagram source is stored when src is set */
+ssize_t Protocol::io_receive(char* dst, std::size_t cap, struct sockaddr_storage* src, socklen_t* src_len) {
+	if (uring != nullptr) {
+		return uring->receive(dst, cap, src, src_len);
+	}
+
+	if (src == nullptr) {
+		return recv(socket_fd, dst, cap, 0);
+	}
+
+	return recvfrom(socket_fd, dst, cap, 0, (struct sockaddr *) src, src_len);
 }
 
 /* tostring function - prints current protocol info to stderr */
@@ -147,21 +367,107 @@ void Protocol::to_string() {
 
 	std::cerr 	<< "\033[4mIPK25-CHAT Protocol\033[0m\n"
 				<< "Transport protocol: " << prot << "\n"
-				<< "Server: " << inet_ntoa(server_address.sin_addr) << ":" << ntohs(server_address.sin_port) << "\n"
+				<< "Server: " << address_string(server_address) << "\n"
 				<< "Dynamic port: " << dyn_port << "\n"
 				<< "Socket file descriptor: " << socket_fd << "\n"
 				<< "Socket type: " << socket_type
 				<< std::endl;
 }
 
+/**
+ *	Socket address helpers
+ */
+bool same_host(const struct sockaddr_storage& a, const struct sockaddr_storage& b) {
+	if (a.ss_family != b.ss_family) {
+		return false;
+	}
+
+	/* Local peer, the server answers from its own socket */
+	if (a.ss_family == AF_UNIX) {
+		return true;
+	}
+
+	if (a.ss_family == AF_INET6) {
+		auto& a6 = reinterpret_cast<const struct sockaddr_in6&>(a);
+		auto& b6 = reinterpret_cast<const struct sockaddr_in6&>(b);
+
+		return std::memcmp(&a6.sin6_addr, &b6.sin6_addr, sizeof(struct in6_addr)) == 0;
+	}
+
+	auto& a4 = reinterpret_cast<const struct sockaddr_in&>(a);
+	auto& b4 = reinterpret_cast<const struct sockaddr_in&>(b);
+
+	return a4.sin_addr.s_addr == b4.sin_addr.s_addr;
+}
+
+uint16_t get_port(const struct sockaddr_storage& address) {
+	if (address.ss_family == AF_UNIX) {
+		return 0;
+	}
+
+	if (address.ss_family == AF_INET6) {
+		return ntohs(reinterpret_cast<const struct sockaddr_in6&>(address).sin6_port);
+	}
+
+	return ntohs(reinterpret_cast<const struct sockaddr_in&>(address).sin_port);
+}
+
+void set_port(struct sockaddr_storage& address, uint16_t port) {
+	if (address.ss_family == AF_INET6) {
+		reinterpret_cast<struct sockaddr_in6&>(address).sin6_port = htons(port);
+	}
+	else if (address.ss_family == AF_INET) {
+		reinterpret_cast<struct sockaddr_in&>(address).sin_port = htons(port);
+	}
+}
+
+/* Printable address, [IPv6]:port or IPv4:port */
+std::string address_string(const struct sockaddr_storage& address) {
+	char host[INET6_ADDRSTRLEN] = "";
+
+	if (address.ss_family == AF_UNIX) {
+		auto& un = reinterpret_cast<const struct sockaddr_un&>(address);
+
+		return std::string(UNIX_SCHEME) + (un.sun_path[0] == '\0' ? "@" + std::string(un.sun_path + 1) : un.sun_path);
+	}
+
+	if (address.ss_family == AF_INET6) {
+		inet_ntop(AF_INET6, &reinterpret_cast<const struct sockaddr_in6&>(address).sin6_addr, host, sizeof(host));
+
+		return "[" + std::string(host) + "]:" + std::to_string(get_port(address));
+	}
+
+	inet_ntop(AF_INET, &reinterpret_cast<const struct sockaddr_in&>(address).sin_addr, host, sizeof(host));
+
+	return std::string(host) + ":" + std::to_string(get_port(address));
+}
+
 /* await function - waits for a given time interval for a concrete message */
 int Protocol::await_response(uint16_t timeout, int expected, Response& response) {
-	struct pollfd pfd = {socket_fd, POLLIN, 0};
+	PROBE(await_enter, expected, timeout, 0);
+
+	int result = await(timeout, expected, response);
+
+	PROBE(await_exit, response.type, result, 0);
+
+	return result;
+}
+
+/* await loop - receives and buffers messages until the expected one arrives */
+int Protocol::await(uint16_t timeout, int expected, Response& response) {
+	struct pollfd pfd = {get_socket(), POLLIN, 0};
 	
 	while (true) {
-		int ready = poll(&pfd, 1, timeout);
+		/* Messages left from the previous receive go first */
+		bool buffered = pending();
+		int ready = buffered ? 1 : wait(&pfd, 1, timeout);
+
+		if (ready < 0) {
+			/* Interrupted by a signal, revents are not valid */
+			if (errno == EINTR) {
+				continue;
+			}
 
-		if (ready < 0 && errno != EINTR) {
 			local_error("poll() failure");
 			return GENERAL_ERROR;
 		}
@@ -170,9 +476,9 @@ int Protocol::await_response(uint16_t timeout, int expected, Response& response)
 			return TIMEOUT;
 		}
 
-		if (pfd.revents & POLLIN) {
+		if (buffered || (pfd.revents & POLLIN)) {
 			/* Receive from the socket */
-			if (receive()) {
+			if (!buffered && receive()) {
 				local_error("Await - receive()");
 				return NETWORK_ERROR;
 			}
@@ -1,50 +1,85 @@
 #pragma once
 
-#include "client.hpp"
 #include "config.hpp"
 #include "message.hpp"
 #include "msg_factory.hpp"
+#include "resolver.hpp"
+#include "response_queue.hpp"
+#include "uring.hpp"
 
+#include <chrono>
 #include <cstdint>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <memory>
-#include <queue>
+#include <string>
+#include <vector>
 
 class Client; // declaration forwarding
 
+/* Socket address helpers */
+bool same_host(const struct sockaddr_storage& a, const struct sockaddr_storage& b);
+uint16_t get_port(const struct sockaddr_storage& address);
+void set_port(struct sockaddr_storage& address, uint16_t port);
+std::string address_string(const struct sockaddr_storage& address);
+
 /* Abstraction of protocol, 
  * encapsulates both transport layer and IPK25-CHAT protocols
  */
 class Protocol {
 	public:
+		using Factory = MsgFactory;
+
 		/* Create and setup protocol (static) class method */
 		static std::unique_ptr<Protocol> protocol_setup(Config &config);
 		
 		/* Protocol utilities */
 		Protocol(Config &config);
-		void bind_client(Client* client);
 		MsgFactory& get_msg_factory();
-		int create_socket();
+		int create_socket(int family);
 		void to_string();
 		int get_socket();
-		std::queue<Response>& get_msg_queue();
-		int get_address(const char* ip_hname);
+		ResponseQueue& get_msg_queue();
+
+		/* Connection establishment, stepped by the client loop while user input is read */
+		int connect_fd();
+		int connect_wait();
+		int connect_step();
+		bool is_connected() const;
 
+		/* Drop the connection and go back to its setup, the resolved addresses are kept */
+		int reconnect();
+
+		/* poll() preceded by the busy-poll budget */
+		int wait(struct pollfd* pfds, unsigned count, int timeout);
 
 		/* Protocol AWAIT response method in request states */
 		int await_response(uint16_t timeout, int expected, Response& response);
 
+		/* Reply timeout of requests */
+		uint16_t get_timeout() const;
+
 		/* Virtual methods, implemented by concrete protocols */
 		virtual ~Protocol();
 		virtual int connect() = 0;
+		virtual int connect_poll();
+		virtual int handshake_fd();
 		virtual int send(std::string msg) = 0;
 		virtual int receive() = 0;
 		virtual int process(Response& response) = 0;
 		virtual int error(std::string err) = 0;
-		virtual int disconnect(std::string id) = 0;
+		virtual int disconnect(std::string_view id) = 0;
+
+		/* Messages received but not processed yet, streams may deliver several per receive */
+		virtual bool pending();
 
 	protected:
+		/* Transport state of a new session, see reconnect */
+		virtual int reset() = 0;
+
+		/* AWAIT receive loop */
+		int await(uint16_t timeout, int expected, Response& response);
+
 		/* Type of used protocol */
 		Config::Protocol protocol_type;
 
@@ -56,16 +91,48 @@ class Protocol {
 		int socket_type;
 
 		/* Server address & port info */
-		struct sockaddr_in server_address;
+		struct sockaddr_storage server_address;
+		socklen_t server_address_len;
 		uint16_t dyn_port;
 
+		/* Resolved server addresses, families interleaved (RFC 8305) */
+		std::vector<Endpoint> endpoints;
+		Resolver resolver;
+
+		/* Connection setup state */
+		std::chrono::steady_clock::time_point connect_deadline;
+		bool handshake = false;
+		bool connected = false;
+
+		int resolved();
+
+		/* Non-blocking socket of the given family */
+		int open_socket(int family);
+
+		/* Latency profile */
+		bool low_latency;
+		uint32_t spin_us;
+
+		/* Default busy-poll time (microseconds) and socket buffer size of the latency profile */
+		static constexpr int BUSY_POLL = 50;
+		static constexpr int SOCKET_BUFFER = 262144;
+
+		void tune_socket(int fd, int family);
+
+		/* io_uring backend, system calls when not set */
+		std::unique_ptr<Uring> uring;
+
+		/* Socket I/O, through the io_uring backend when enabled */
+		ssize_t io_send(const std::string& msg, const struct sockaddr* dst, socklen_t dst_len);
+		ssize_t io_receive(char* dst, std::size_t cap, struct sockaddr_storage* src, socklen_t* src_len);
+
 		/* Reply timeout, 5000 milliseconds */
 		const uint16_t timeout = 5000;
 
-		/* Receive buffer */
-		char buffer[65536];
+		/* Receive buffer, room for a partial TCP message and a full 64 KiB read */
+		char buffer[131072];
 		int b_rx;
 
 		/* Message queue */
-		std::queue<Response> msg_queue;
+		ResponseQueue msg_queue;
 };
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "recorder.hpp"
+#include "error.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace recorder {
+	RecRecord ring[CAPACITY];
+	std::atomic<uint64_t> head{0};
+}
+
+/* Dump file path, prepared ahead so that dump() is async-signal-safe */
+static char dump_path[256];
+
+/* Write the whole buffer, retrying on partial writes */
+static int write_all(int fd, const void* data, size_t len) {
+	const char* p = static_cast<const char*>(data);
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0) {
+			return -1;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Ring dump, only async-signal-safe calls are used */
+int recorder::dump() {
+	RecHeader header = {};
+
+	for (int i = 0; i < 8; ++i) {
+		header.magic[i] = MAGIC[i];
+	}
+
+	header.version = VERSION;
+	header.capacity = CAPACITY;
+	header.head = head.load(std::memory_order_relaxed);
+
+	int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		return GENERAL_ERROR;
+	}
+
+	int result = write_all(fd, &header, sizeof(header)) || write_all(fd, ring, sizeof(ring));
+
+	close(fd);
+
+	return result ? GENERAL_ERROR : SUCCESS;
+}
+
+/* SIGUSR1 - dump on demand, session continues */
+static void catch_dump(int signal) {
+	int saved_errno = errno;
+	recorder::dump();
+	errno = saved_errno;
+}
+
+/* Fatal signals - dump, then die with the default action */
+static void catch_fatal(int signal) {
+	recorder::dump();
+	raise(signal);
+}
+
+/* Dump path setup and signal handlers
+ * Path may be overriden with the IPK25_RECORDER environment variable
+ */
+int recorder::install() {
+	const char* env = std::getenv("IPK25_RECORDER");
+
+	if (env != nullptr) {
+		std::snprintf(dump_path, sizeof(dump_path), "%s", env);
+	}
+	else {
+		std::snprintf(dump_path, sizeof(dump_path), "ipk25chat-client.%d.rec", static_cast<int>(getpid()));
+	}
+
+	struct sigaction dump_action = {};
+	dump_action.sa_handler = catch_dump;
+	dump_action.sa_flags = SA_RESTART;
+	sigemptyset(&dump_action.sa_mask);
+
+	if (sigaction(SIGUSR1, &dump_action, nullptr) == -1) {
+		local_error("sigaction()");
+		return GENERAL_ERROR;
+	}
+
+	struct sigaction fatal_action = {};
+	fatal_action.sa_handler = catch_fatal;
+	fatal_action.sa_flags = SA_RESETHAND;
+	sigemptyset(&fatal_action.sa_mask);
+
+	for (int signal : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+		if (sigaction(signal, &fatal_action, nullptr) == -1) {
+			local_error("sigaction()");
+			return GENERAL_ERROR;
+		}
+	}
+
+	return SUCCESS;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file: recorder.hpp
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+/* Flight recorder event kinds */
+enum class RecEvent : uint8_t {
+	SEND,       // Message sent to the server
+	RECV,       // Message received and parsed
+	CONFIRM,    // CONFIRM received for a client message (UDP only)
+	RETRANSMIT, // Message retransmission after confirmation timeout (UDP only)
+	STATE,      // Client state transition, msg_type = old state, msg_id = new state
+	PARSE_FAIL  // Received message could not be parsed
+};
+
+/* Compact binary event record, 16 bytes
+ *
+ *      8 bytes      4 bytes   2 bytes   1 byte   1 byte
+ * +--------------+---------+---------+--------+--------+
+ * |  Timestamp   |  Size   |  MsgID  | Event  |  Type  |
+ * +--------------+---------+---------+--------+--------+
+ */
+struct RecRecord {
+	uint64_t timestamp; // Monotonic clock, nanoseconds
+	uint32_t size;      // Message size in bytes
+	uint16_t msg_id;    // Message ID, zero for TCP
+	uint8_t event;      // RecEvent
+	uint8_t msg_type;   // MsgType
+};
+
+/* Dump file header, followed by capacity records in ring order */
+struct RecHeader {
+	char magic[8];     // "IPK25REC"
+	uint32_t version;  // Dump format version
+	uint32_t capacity; // Number of ring slots
+	uint64_t head;     // Total number of events ever recorded
+};
+
+namespace recorder {
+	inline constexpr char MAGIC[8] = {'I', 'P', 'K', '2', '5', 'R', 'E', 'C'};
+	inline constexpr uint32_t VERSION = 1;
+	inline constexpr uint32_t CAPACITY = 4096; // Must be a power of two
+
+	/* Ring storage, defined in recorder.cpp */
+	extern RecRecord ring[CAPACITY];
+	extern std::atomic<uint64_t> head;
+
+	/* Record a single event - one atomic increment and a 16 byte store */
+	inline void record(RecEvent event, uint8_t msg_type, uint16_t msg_id, uint32_t size) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		uint64_t idx = head.fetch_add(1, std::memory_order_relaxed);
+
+		ring[idx & (CAPACITY - 1)] = {
+			static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec),
+			size, msg_id, static_cast<uint8_t>(event), msg_type
+		};
+	}
+
+	/* Setup dump path and dump-on-signal handlers (SIGUSR1 on demand, fatal signals) */
+	int install();
+
+	/* Write the ring into the dump file, async-signal-safe */
+	int dump();
+}
@@ -0,0 +1,401 @@
+#include "resolver.hpp"
+#include "error.hpp"
+#include "protocol.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+struct Resolver::Query {
+	std::string host;
+	uint16_t port;
+	int socktype;
+
+	int fd = -1; // eventfd, signalled by the lookup thread
+
+	std::mutex mutex;
+	bool done = false;
+	int status = SUCCESS;
+	std::vector<Endpoint> endpoints;
+
+	~Query() {
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+};
+
+/* Order addresses by interleaving families, starting with the first returned one (RFC 8305, section 4) */
+static void order_endpoints(struct addrinfo* addrinfo, std::vector<Endpoint>& endpoints) {
+	std::vector<Endpoint> preferred, other;
+	int preferred_family = addrinfo->ai_family;
+
+	for (struct addrinfo* ai = addrinfo; ai != nullptr; ai = ai->ai_next) {
+		Endpoint endpoint = {};
+
+		std::memcpy(&endpoint.address, ai->ai_addr, ai->ai_addrlen);
+		endpoint.length = ai->ai_addrlen;
+
+		(ai->ai_family == preferred_family ? preferred : other).push_back(endpoint);
+	}
+
+	endpoints.clear();
+
+	for (std::size_t i = 0; i < preferred.size() || i < other.size(); ++i) {
+		if (i < preferred.size()) {
+			endpoints.push_back(preferred[i]);
+		}
+
+		if (i < other.size()) {
+			endpoints.push_back(other[i]);
+		}
+	}
+}
+
+static int lookup(const std::string& host, uint16_t port, int socktype, int flags, std::vector<Endpoint>& endpoints) {
+	struct addrinfo *addrinfo, hints{};
+
+	/* Any family, protocol filter */
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = socktype;
+	hints.ai_flags = flags;
+
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addrinfo) != 0) {
+		return ADDRESS_ERROR;
+	}
+
+	order_endpoints(addrinfo, endpoints);
+	freeaddrinfo(addrinfo);
+
+	return SUCCESS;
+}
+
+/* /path or @abstract-name */
+bool unix_endpoint(std::string_view path, Endpoint& endpoint) {
+	auto& un = reinterpret_cast<struct sockaddr_un&>(endpoint.address);
+
+	std::memset(&endpoint, 0, sizeof(endpoint));
+
+	if (path.empty() || path.length() >= sizeof(un.sun_path)) {
+		return false;
+	}
+
+	un.sun_family = AF_UNIX;
+	std::memcpy(un.sun_path, path.data(), path.length());
+	endpoint.length = offsetof(struct sockaddr_un, sun_path) + path.length();
+
+	/* Abstract names are not NUL terminated */
+	if (path[0] == '@') {
+		un.sun_path[0] = '\0';
+	}
+	else {
+		endpoint.length += 1;
+	}
+
+	return true;
+}
+
+int Resolver::start(const char* host, uint16_t port, int socktype) {
+	query = std::make_shared<Query>();
+
+	query->host = host;
+	query->port = port;
+	query->socktype = socktype;
+
+	/* Unix-domain socket, same wire format without the IP stack */
+	if (query->host.compare(0, UNIX_SCHEME.length(), UNIX_SCHEME) == 0) {
+		Endpoint endpoint;
+
+		if (!unix_endpoint(std::string_view(query->host).substr(UNIX_SCHEME.length()), endpoint)) {
+			local_error("Invalid Unix socket path ", query->host);
+			return ADDRESS_ERROR;
+		}
+
+		query->endpoints.push_back(endpoint);
+		query->done = true;
+		return SUCCESS;
+	}
+
+	/* IP address literal, nothing to wait for */
+	if (lookup(query->host, port, socktype, AI_NUMERICHOST, query->endpoints) == SUCCESS) {
+		query->done = true;
+		return SUCCESS;
+	}
+
+	if (dns_cache::lookup(query->host, port, socktype, query->endpoints)) {
+		log("[DNS] cached ", query->host);
+		query->done = true;
+		cached = true;
+		return SUCCESS;
+	}
+
+	query->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (query->fd < 0) {
+		local_error("eventfd()");
+		return GENERAL_ERROR;
+	}
+
+	/* getaddrinfo cannot be cancelled, the thread owns the query until it returns */
+	try {
+		std::thread([query = query] {
+			std::vector<Endpoint> endpoints;
+			int status = lookup(query->host, query->port, query->socktype, AI_ADDRCONFIG, endpoints);
+
+			{
+				std::lock_guard<std::mutex> lock(query->mutex);
+				query->status = status;
+				query->endpoints.swap(endpoints);
+				query->done = true;
+			}
+
+			uint64_t one = 1;
+
+			if (write(query->fd, &one, sizeof(one)) < 0) {
+				/* Nothing to do, the reader checks the done flag */
+			}
+		}).detach();
+	} catch (const std::exception& e) {
+		local_error("Resolver thread - ", e.what());
+		return GENERAL_ERROR;
+	}
+
+	return SUCCESS;
+}
+
+bool Resolver::pending() const {
+	if (query == nullptr) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(query->mutex);
+
+	return !query->done;
+}
+
+int Resolver::get_fd() const {
+	return pending() ? query->fd : -1;
+}
+
+int Resolver::result(std::vector<Endpoint>& endpoints) {
+	std::lock_guard<std::mutex> lock(query->mutex);
+
+	if (!query->done) {
+		return TIMEOUT;
+	}
+
+	if (query->status != SUCCESS || query->endpoints.empty()) {
+		local_error("Unable to get host (", query->host, ") address information");
+		return ADDRESS_ERROR;
+	}
+
+	endpoints = query->endpoints;
+
+	/* Fresh result from the resolver thread */
+	if (query->fd >= 0) {
+		dns_cache::store(query->host, query->port, query->socktype, endpoints);
+	}
+
+	return SUCCESS;
+}
+
+void Resolver::forget() {
+	if (query != nullptr && cached) {
+		dns_cache::forget(query->host, query->port, query->socktype);
+	}
+}
+
+/**
+ *	Resolution cache file, one address per line:
+ *	<expiry> <socktype> <port> <host> <address>
+ */
+namespace {
+
+/* Default entry lifetime, seconds */
+constexpr long DEFAULT_TTL = 300;
+
+std::string cache_path() {
+	if (const char* path = std::getenv("IPK25_DNS_CACHE")) {
+		return path;
+	}
+
+	std::string dir;
+
+	if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+		dir = xdg;
+	}
+	else if (const char* home = std::getenv("HOME")) {
+		dir = std::string(home) + "/.cache";
+	}
+	else {
+		return "";
+	}
+
+	mkdir(dir.c_str(), 0755);
+	dir += "/ipk25chat-client";
+	mkdir(dir.c_str(), 0755);
+
+	return dir + "/hosts";
+}
+
+long ttl() {
+	const char* value = std::getenv("IPK25_DNS_TTL");
+
+	return value != nullptr ? std::strtol(value, nullptr, 10) : DEFAULT_TTL;
+}
+
+struct CacheLine {
+	long expiry;
+	int socktype;
+	uint16_t port;
+	std::string host;
+	std::string address;
+};
+
+bool parse_line(const std::string& line, CacheLine& entry) {
+	std::istringstream fields(line);
+
+	return static_cast<bool>(fields >> entry.expiry >> entry.socktype >> entry.port >> entry.host >> entry.address);
+}
+
+bool to_endpoint(const std::string& text, uint16_t port, Endpoint& endpoint) {
+	std::memset(&endpoint, 0, sizeof(endpoint));
+
+	auto& in6 = reinterpret_cast<struct sockaddr_in6&>(endpoint.address);
+	auto& in4 = reinterpret_cast<struct sockaddr_in&>(endpoint.address);
+
+	if (inet_pton(AF_INET6, text.c_str(), &in6.sin6_addr) == 1) {
+		in6.sin6_family = AF_INET6;
+		endpoint.length = sizeof(struct sockaddr_in6);
+	}
+	else if (inet_pton(AF_INET, text.c_str(), &in4.sin_addr) == 1) {
+		in4.sin_family = AF_INET;
+		endpoint.length = sizeof(struct sockaddr_in);
+	}
+	else {
+		return false;
+	}
+
+	set_port(endpoint.address, port);
+
+	return true;
+}
+
+/* Host part of address_string */
+std::string host_string(const Endpoint& endpoint) {
+	std::string text = address_string(endpoint.address);
+
+	text.erase(text.rfind(':'));
+
+	if (text.front() == '[') {
+		text = text.substr(1, text.length() - 2);
+	}
+
+	return text;
+}
+
+/* Rewrite the cache without the entry and expired lines, optionally appending new lines */
+void rewrite(const std::string& host, uint16_t port, int socktype, const std::string& append) {
+	std::string path = cache_path();
+
+	if (path.empty()) {
+		return;
+	}
+
+	std::ifstream in(path);
+	std::string kept, line;
+	long now = std::time(nullptr);
+
+	for (CacheLine entry; std::getline(in, line);) {
+		if (!parse_line(line, entry) || entry.expiry <= now) {
+			continue;
+		}
+
+		if (entry.host == host && entry.port == port && entry.socktype == socktype) {
+			continue;
+		}
+
+		kept += line + "\n";
+	}
+
+	in.close();
+
+	/* Replace atomically, concurrent clients never see a partial file */
+	std::string tmp = path + "." + std::to_string(getpid());
+	std::ofstream out(tmp, std::ios::trunc);
+
+	out << kept << append;
+	out.close();
+
+	if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+		std::remove(tmp.c_str());
+	}
+}
+
+}
+
+bool dns_cache::lookup(const std::string& host, uint16_t port, int socktype, std::vector<Endpoint>& endpoints) {
+	std::string path = cache_path();
+
+	if (path.empty()) {
+		return false;
+	}
+
+	std::ifstream in(path);
+	std::string line;
+	long now = std::time(nullptr);
+
+	endpoints.clear();
+
+	for (CacheLine entry; std::getline(in, line);) {
+		Endpoint endpoint;
+
+		if (!parse_line(line, entry) || entry.expiry <= now) {
+			continue;
+		}
+
+		if (entry.host == host && entry.port == port && entry.socktype == socktype && to_endpoint(entry.address, port, endpoint)) {
+			endpoints.push_back(endpoint);
+		}
+	}
+
+	return !endpoints.empty();
+}
+
+void dns_cache::store(const std::string& host, uint16_t port, int socktype, const std::vector<Endpoint>& endpoints) {
+	long lifetime = ttl();
+
+	if (lifetime <= 0) {
+		return;
+	}
+
+	std::string lines;
+	std::string prefix = std::to_string(std::time(nullptr) + lifetime) + " " + std::to_string(socktype) + " "
+		+ std::to_string(port) + " " + host + " ";
+
+	/* Written in resolution order, read back in the same order */
+	for (const Endpoint& endpoint : endpoints) {
+		lines += prefix + host_string(endpoint) + "\n";
+	}
+
+	rewrite(host, port, socktype, lines);
+}
+
+void dns_cache::forget(const std::string& host, uint16_t port, int socktype) {
+	rewrite(host, port, socktype, "");
+}
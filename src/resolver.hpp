@@ -0,0 +1,64 @@
+/**
+ * @file: resolver.hpp
+ *
+ * Asynchronous server name resolution. getaddrinfo runs on a helper thread and signals
+ * completion through an eventfd, so the client loop polls it next to stdin.
+ * Numeric addresses, Unix socket paths and cached names are resolved immediately.
+ *
+ * Cache file: $XDG_CACHE_HOME/ipk25chat-client/hosts (or ~/.cache/...), overridden by IPK25_DNS_CACHE.
+ * getaddrinfo does not expose record TTLs, entries expire after IPK25_DNS_TTL seconds (default 300).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <vector>
+
+/* Host prefix of Unix-domain socket addresses, unix:/path or unix:@abstract-name */
+inline constexpr std::string_view UNIX_SCHEME = "unix:";
+
+/* Resolved server address */
+struct Endpoint {
+	struct sockaddr_storage address;
+	socklen_t length;
+};
+
+/* Unix-domain socket address of a path, @name for the abstract namespace */
+bool unix_endpoint(std::string_view path, Endpoint& endpoint);
+
+class Resolver {
+	public:
+		Resolver() = default;
+
+		/* Begin resolution, completes immediately for numeric hosts and cache hits */
+		int start(const char* host, uint16_t port, int socktype);
+
+		/* Resolution in flight */
+		bool pending() const;
+
+		/* Readable once the resolution completes, -1 when not pending */
+		int get_fd() const;
+
+		/* Resolved addresses, families interleaved starting with the preferred one (RFC 8305) */
+		int result(std::vector<Endpoint>& endpoints);
+
+		/* Drop the cached addresses, e.g. when none of them is reachable */
+		void forget();
+
+	private:
+		/* Query state, shared with the lookup thread */
+		struct Query;
+
+		std::shared_ptr<Query> query;
+		bool cached = false;
+};
+
+namespace dns_cache {
+	bool lookup(const std::string& host, uint16_t port, int socktype, std::vector<Endpoint>& endpoints);
+	void store(const std::string& host, uint16_t port, int socktype, const std::vector<Endpoint>& endpoints);
+	void forget(const std::string& host, uint16_t port, int socktype);
+}
@@ -0,0 +1,86 @@
+#include "response_queue.hpp"
+
+#include <utility>
+
+/* Allocate all slots and their content buffers upfront */
+ResponseQueue::ResponseQueue() : slots(CAPACITY), head{0}, count{0} {
+	for (Response& slot : slots) {
+		slot.storage.reserve(SLOT_RESERVE);
+	}
+}
+
+/* Double the ring, occupied slots are moved to the front in order */
+void ResponseQueue::grow() {
+	std::vector<Response> grown(slots.size() * 2);
+
+	for (std::size_t i = 0; i < grown.size(); ++i) {
+		Response& slot = grown[i];
+
+		if (i < count) {
+			std::size_t dname_len = slots[(head + i) % slots.size()].dname.length();
+
+			slot = std::move(slots[(head + i) % slots.size()]);
+
+			/* A short storage may have been inline, the views follow the moved buffer */
+			slot.dname = std::string_view(slot.storage.data(), dname_len);
+			slot.content = std::string_view(slot.storage.data() + dname_len, slot.content.length());
+		}
+		else {
+			slot.storage.reserve(SLOT_RESERVE);
+		}
+	}
+
+	slots.swap(grown);
+	head = 0;
+}
+
+bool ResponseQueue::empty() const {
+	return count == 0;
+}
+
+std::size_t ResponseQueue::size() const {
+	return count;
+}
+
+void ResponseQueue::push(const Response& response) {
+	if (count == slots.size()) {
+		grow();
+	}
+
+	Response& slot = slots[(head + count) % slots.size()];
+
+	slot.type = response.type;
+	slot.status = response.status;
+	slot.storage.assign(response.dname); // Reuses the slot buffer
+	slot.storage.append(response.content);
+	slot.dname = std::string_view(slot.storage.data(), response.dname.length());
+	slot.content = std::string_view(slot.storage.data() + response.dname.length(), response.content.length());
+	slot.duplicate = response.duplicate;
+	slot.incomplete = response.incomplete;
+
+	++count;
+}
+
+bool ResponseQueue::pop(Response& response) {
+	if (count == 0) {
+		return false;
+	}
+
+	Response& slot = slots[head];
+
+	std::size_t dname_len = slot.dname.length();
+	std::size_t content_len = slot.content.length();
+
+	response.type = slot.type;
+	response.status = slot.status;
+	response.storage.swap(slot.storage); // Consumer buffer goes back to the ring
+	response.dname = std::string_view(response.storage.data(), dname_len);
+	response.content = std::string_view(response.storage.data() + dname_len, content_len);
+	response.duplicate = slot.duplicate;
+	response.incomplete = slot.incomplete;
+
+	head = (head + 1) % slots.size();
+	--count;
+
+	return true;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file: response_queue.hpp
+ */
+
+#pragma once
+
+#include "message.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/* Ring of preallocated Response slots
+ *
+ * Slot storage buffers are reserved once and reused across messages,
+ * push() detaches the response views from the receive buffer into the slot storage,
+ * pop() swaps the buffer with the consumer's Response instead of copying,
+ * so steady-state queueing does not allocate.
+ * A full ring doubles, the slots stay pooled at the new size; the server decides how much arrives.
+ */
+class ResponseQueue {
+	public:
+		static constexpr std::size_t CAPACITY = 256;         // Initial number of slots
+		static constexpr std::size_t SLOT_RESERVE = 256;     // Initial storage buffer size per slot
+
+		ResponseQueue();
+
+		bool empty() const;
+		std::size_t size() const;
+
+		/* Copy the response into the next free slot, grows a full ring */
+		void push(const Response& response);
+
+		/* Hand the oldest response over to the consumer, false if the queue is empty */
+		bool pop(Response& response);
+
+	private:
+		std::vector<Response> slots;
+		std::size_t head;  // Oldest occupied slot
+		std::size_t count; // Number of occupied slots
+
+		void grow();
+};
@@ -0,0 +1,159 @@
+#include "rules.hpp"
+#include "error.hpp"
+#include "message.hpp"
+
+#include <cctype>
+#include <fstream>
+#include <queue>
+
+namespace {
+
+constexpr std::string_view SEPARATOR = " => ";
+
+std::string_view trim(std::string_view text) {
+	std::size_t begin = text.find_first_not_of(" \t\r");
+	std::size_t end = text.find_last_not_of(" \t\r");
+
+	return begin == std::string_view::npos ? std::string_view() : text.substr(begin, end - begin + 1);
+}
+
+}
+
+std::unique_ptr<RuleEngine> RuleEngine::load(const char* path) {
+	std::ifstream in(path);
+
+	if (!in) {
+		local_error("Unable to open rule file ", path);
+		return nullptr;
+	}
+
+	std::unique_ptr<RuleEngine> engine(new RuleEngine());
+	std::string line;
+
+	for (std::size_t number = 1; std::getline(in, line); ++number) {
+		std::string_view text = trim(line);
+
+		if (text.empty() || text.front() == '#') {
+			continue;
+		}
+
+		std::size_t separator = text.find(SEPARATOR);
+		std::string_view pattern, response;
+
+		if (separator != std::string_view::npos) {
+			pattern = trim(text.substr(0, separator));
+			response = trim(text.substr(separator + SEPARATOR.length()));
+		}
+
+		if (pattern.empty() || response.empty() || response.length() > MAX_MSG_LEN || !valid_printable_msg(response)) {
+			local_error("Invalid rule on line ", number, " of ", path);
+			return nullptr;
+		}
+
+		engine->add(std::string(pattern), std::string(response));
+	}
+
+	engine->compile();
+	log("[RULES] ", engine->size(), " rules, ", engine->output.size(), " states, ", engine->class_count, " byte classes");
+
+	return engine;
+}
+
+void RuleEngine::add(std::string pattern, std::string response) {
+	for (char& c : pattern) {
+		c = std::tolower(static_cast<unsigned char>(c));
+	}
+
+	rules.push_back({std::move(pattern), std::move(response), -1, 0});
+}
+
+void RuleEngine::compile() {
+	/* Byte classes, upper and lower case letters share one */
+	for (const Rule& rule : rules) {
+		for (unsigned char c : rule.pattern) {
+			if (classes[c] == 0) {
+				classes[c] = class_count;
+				classes[std::toupper(c)] = class_count;
+				++class_count;
+			}
+		}
+	}
+
+	/* Trie, missing edges are 0 since the root is never a child */
+	transitions.assign(class_count, 0);
+	output.assign(1, -1);
+
+	for (std::size_t r = 0; r < rules.size(); ++r) {
+		uint32_t state = 0;
+
+		for (unsigned char c : rules[r].pattern) {
+			uint32_t& edge = transitions[state * class_count + classes[c]];
+
+			if (edge == 0) {
+				edge = output.size();
+				output.push_back(-1);
+				transitions.resize(output.size() * class_count, 0);
+			}
+
+			state = transitions[state * class_count + classes[c]];
+		}
+
+		rules[r].next = output[state];
+		output[state] = r;
+	}
+
+	/* Breadth-first failure links, folded into the transition table */
+	std::vector<uint32_t> failure(output.size(), 0);
+	std::queue<uint32_t> queue;
+
+	dictionary.assign(output.size(), 0);
+
+	for (std::size_t c = 0; c < class_count; ++c) {
+		if (transitions[c] != 0) {
+			queue.push(transitions[c]);
+		}
+	}
+
+	while (!queue.empty()) {
+		uint32_t state = queue.front();
+		queue.pop();
+
+		for (std::size_t c = 0; c < class_count; ++c) {
+			uint32_t& edge = transitions[state * class_count + c];
+			uint32_t fallback = transitions[failure[state] * class_count + c];
+
+			if (edge == 0) {
+				edge = fallback;
+				continue;
+			}
+
+			failure[edge] = fallback;
+			dictionary[edge] = output[fallback] != -1 ? fallback : dictionary[fallback];
+			queue.push(edge);
+		}
+	}
+}
+
+/* One table lookup per byte, matches are reported through the dictionary links */
+void RuleEngine::scan(std::string_view content, const std::function<void(std::string_view)>& respond) {
+	uint32_t state = 0;
+
+	++messages;
+
+	for (unsigned char c : content) {
+		state = transitions[state * class_count + classes[c]];
+
+		for (uint32_t match = output[state] != -1 ? state : dictionary[state]; match != 0; match = dictionary[match]) {
+			for (int32_t r = output[match]; r != -1; r = rules[r].next) {
+				if (rules[r].fired != messages) {
+					rules[r].fired = messages;
+					respond(rules[r].response);
+				}
+			}
+		}
+	}
+}
+
+std::size_t RuleEngine::size() const {
+	return rules.size();
+}
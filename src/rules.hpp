@@ -0,0 +1,53 @@
+/**
+ * @file: rules.hpp
+ *
+ * Bot rule engine, enabled by --rules <file>.
+ * Rule file lines are "pattern => response", '#' starts a comment line.
+ * All patterns are compiled into one Aho-Corasick automaton with a dense transition table over
+ * the pattern byte classes, each inbound message is scanned once, matching is ASCII case-insensitive.
+ * Every matching rule fires at most once per message.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RuleEngine {
+	public:
+		static std::unique_ptr<RuleEngine> load(const char* path);
+
+		/* Visit the responses of rules whose pattern occurs in the content */
+		void scan(std::string_view content, const std::function<void(std::string_view)>& respond);
+
+		std::size_t size() const;
+
+	private:
+		struct Rule {
+			std::string pattern;
+			std::string response;
+			int32_t next;        // Next rule with the same pattern, -1 at the end
+			uint64_t fired;      // Last message the rule fired for
+		};
+
+		std::vector<Rule> rules;
+
+		/* Byte to class, 0 is any byte absent from the patterns */
+		uint8_t classes[256] = {};
+		std::size_t class_count = 1;
+
+		/* Automaton, state 0 is the root */
+		std::vector<uint32_t> transitions; // state * class_count + class
+		std::vector<int32_t> output;       // First rule ending in the state, -1 if none
+		std::vector<uint32_t> dictionary;  // Nearest suffix state with an output, 0 if none
+
+		uint64_t messages = 0;
+
+		void add(std::string pattern, std::string response);
+		void compile();
+};
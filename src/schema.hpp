@@ -0,0 +1,473 @@
+/**
+ * @file: schema.hpp
+ *
+ * Declarative IPK25-CHAT message schema.
+ *
+ * Every message type lists its fields once - TCP keyword, character class and length limit.
+ * Serializers and parsers for both wire formats are generated from the schema at compile time,
+ * field validation lives only here.
+ *
+ *  TCP:  {NAME} [{OK|NOK}] [KEYWORD] {Field} [KEYWORD] {Field} ...\r\n
+ *
+ *  UDP:  1 byte       2 bytes       [1 byte]  [2 bytes]     n bytes
+ *       +--------+-----------------+--------+------------+---~~---+---+---~~---+---+
+ *       |  Type  |    MessageID    | Result | Ref_MsgID  | Field  | 0 | Field  | 0 |
+ *       +--------+-----------------+--------+------------+---~~---+---+---~~---+---+
+ */
+
+#pragma once
+
+#include "error.hpp"
+#include "message.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace schema {
+
+/* Field character classes */
+enum class Charset : uint8_t {
+	ID,        // Alphanumeric chars, underscore, dash (Username, ChannelID, Secret)
+	PRINTABLE, // Printable ASCII chars from ! to ~ (DisplayName)
+	CONTENT    // Printable ASCII chars from ! to ~, space, linefeed (MessageContent)
+};
+
+/* Message field description */
+struct Field {
+	const char* keyword; // TCP keyword preceding the field, nullptr if none
+	Charset charset;     // Allowed characters
+	uint16_t max_len;    // Maximum length in bytes
+};
+
+/* Message schemas */
+template <MsgType T>
+struct Schema;
+
+template <>
+struct Schema<CONFIRM> {
+	static constexpr const char* name = nullptr; // UDP only
+	static constexpr bool status = false;
+	static constexpr std::array<Field, 0> fields{};
+};
+
+template <>
+struct Schema<REPLY> {
+	static constexpr const char* name = "REPLY";
+	static constexpr bool status = true;
+	static constexpr std::array<Field, 1> fields{{
+		{"IS", Charset::CONTENT, MAX_MSG_LEN}
+	}};
+};
+
+template <>
+struct Schema<AUTH> {
+	static constexpr const char* name = "AUTH";
+	static constexpr bool status = false;
+	static constexpr std::array<Field, 3> fields{{
+		{nullptr, Charset::ID, MAX_ID_LEN},
+		{"AS", Charset::PRINTABLE, MAX_DN_LEN},
+		{"USING", Charset::ID, MAX_SECRET_LEN}
+	}};
+};
+
+template <>
+struct Schema<JOIN> {
+	static constexpr const char* name = "JOIN";
+	static constexpr bool status = false;
+	static constexpr std::array<Field, 2> fields{{
+		{nullptr, Charset::PRINTABLE, MAX_CID_LEN},
+		{"AS", Charset::PRINTABLE, MAX_DN_LEN}
+	}};
+};
+
+template <>
+struct Schema<MSG> {
+	static constexpr const char* name = "MSG";
+	static constexpr bool status = false;
+	static constexpr std::array<Field, 2> fields{{
+		{"FROM", Charset::PRINTABLE, MAX_DN_LEN},
+		{"IS", Charset::CONTENT, MAX_MSG_LEN}
+	}};
+};
+
+template <>
+struct Schema<PING> {
+	static constexpr const char* name = nullptr; // UDP only
+	static constexpr bool status = false;
+	static constexpr std::array<Field, 0> fields{};
+};
+
+template <>
+struct Schema<ERR> {
+	static constexpr const char* name = "ERR";
+	static constexpr bool status = false;
+	static constexpr std::array<Field, 2> fields{{
+		{"FROM", Charset::PRINTABLE, MAX_DN_LEN},
+		{"IS", Charset::CONTENT, MAX_MSG_LEN}
+	}};
+};
+
+template <>
+struct Schema<BYE> {
+	static constexpr const char* name = "BYE";
+	static constexpr bool status = false;
+	static constexpr std::array<Field, 1> fields{{
+		{"FROM", Charset::PRINTABLE, MAX_DN_LEN}
+	}};
+};
+
+/* Maximum number of fields of any message */
+inline constexpr std::size_t MAX_FIELDS = 3;
+
+/* Wire formats */
+struct TcpWire {
+	static constexpr bool binary = false;
+};
+
+struct UdpWire {
+	static constexpr bool binary = true;
+};
+
+/* Generic message, fields are views into the parsed data or the caller's strings */
+struct Message {
+	MsgType type = UNKNOWN;
+	ResponseStatus status = NONE;          // REPLY result
+	uint16_t id = 0;                       // UDP MessageID
+	uint16_t ref_id = 0;                   // UDP Ref_MessageID (REPLY)
+	std::string_view fields[MAX_FIELDS];   // Field values in schema order
+};
+
+/**
+ *	Validation
+ */
+constexpr bool in_charset(Charset charset, char c) {
+	switch (charset) {
+		case Charset::ID:
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+
+		case Charset::PRINTABLE:
+			return c >= 0x21 && c <= 0x7E;
+
+		case Charset::CONTENT:
+			return (c >= 0x20 && c <= 0x7E) || c == 0x0A;
+	}
+
+	return false;
+}
+
+constexpr bool valid_chars(Charset charset, std::string_view value) {
+	for (char c : value) {
+		if (!in_charset(charset, c)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Non-empty, within the length limit and of the field character class */
+constexpr bool valid(const Field& field, std::string_view value) {
+	return !value.empty() && value.length() <= field.max_len && valid_chars(field.charset, value);
+}
+
+/* Validate all field values of a message type */
+template <MsgType T, std::size_t N>
+bool valid(const std::string_view (&values)[N]) {
+	static_assert(N == Schema<T>::fields.size(), "Field count does not match the schema");
+
+	for (std::size_t i = 0; i < N; ++i) {
+		if (!valid(Schema<T>::fields[i], values[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ *	Serialization
+ */
+constexpr std::size_t length(const char* str) {
+	std::size_t len = 0;
+
+	while (str != nullptr && str[len] != '\0') {
+		++len;
+	}
+
+	return len;
+}
+
+/* Constant part of the serialized message size */
+template <MsgType T, class Wire>
+constexpr std::size_t fixed_size() {
+	std::size_t size = 0;
+
+	if constexpr (Wire::binary) {
+		size = 3 + (Schema<T>::status ? 3 : 0) + Schema<T>::fields.size();
+	}
+	else {
+		size = length(Schema<T>::name) + (Schema<T>::status ? 4 : 0) + 2;
+
+		for (const Field& field : Schema<T>::fields) {
+			size += 1 + (field.keyword ? length(field.keyword) + 1 : 0);
+		}
+	}
+
+	return size;
+}
+
+/* Serialize a message of type T into out, reusing its capacity
+ * UDP MessageID is left zero, it is bound when sending
+ */
+template <MsgType T, class Wire>
+void serialize(std::string& out, const Message& msg) {
+	std::size_t size = fixed_size<T, Wire>();
+
+	for (std::size_t i = 0; i < Schema<T>::fields.size(); ++i) {
+		size += msg.fields[i].length();
+	}
+
+	out.clear();
+	out.reserve(size);
+
+	if constexpr (Wire::binary) {
+		out.push_back(static_cast<char>(T));
+		out.push_back(static_cast<char>(msg.id >> 8));
+		out.push_back(static_cast<char>(msg.id & 0xFF));
+
+		if constexpr (Schema<T>::status) {
+			out.push_back(msg.status == OK ? 1 : 0);
+			out.push_back(static_cast<char>(msg.ref_id >> 8));
+			out.push_back(static_cast<char>(msg.ref_id & 0xFF));
+		}
+
+		for (std::size_t i = 0; i < Schema<T>::fields.size(); ++i) {
+			out.append(msg.fields[i]);
+			out.push_back('\0');
+		}
+	}
+	else {
+		out.append(Schema<T>::name);
+
+		if constexpr (Schema<T>::status) {
+			out.append(msg.status == OK ? " OK" : " NOK");
+		}
+
+		for (std::size_t i = 0; i < Schema<T>::fields.size(); ++i) {
+			out.push_back(' ');
+
+			if (Schema<T>::fields[i].keyword != nullptr) {
+				out.append(Schema<T>::fields[i].keyword);
+				out.push_back(' ');
+			}
+
+			out.append(msg.fields[i]);
+		}
+
+		out.append(CRLF);
+	}
+}
+
+/* Serialize a message of any type, false if the type has no representation in the wire format */
+template <class Wire>
+bool serialize(std::string& out, const Message& msg) {
+	switch (msg.type) {
+		case REPLY: serialize<REPLY, Wire>(out, msg); return true;
+		case AUTH:  serialize<AUTH, Wire>(out, msg);  return true;
+		case JOIN:  serialize<JOIN, Wire>(out, msg);  return true;
+		case MSG:   serialize<MSG, Wire>(out, msg);   return true;
+		case ERR:   serialize<ERR, Wire>(out, msg);   return true;
+		case BYE:   serialize<BYE, Wire>(out, msg);   return true;
+		default: break;
+	}
+
+	if constexpr (Wire::binary) {
+		switch (msg.type) {
+			case CONFIRM: serialize<CONFIRM, Wire>(out, msg); return true;
+			case PING:    serialize<PING, Wire>(out, msg);    return true;
+			default: break;
+		}
+	}
+
+	return false;
+}
+
+/**
+ *	Parsing
+ */
+namespace detail {
+	/* Next whitespace delimited token, advances the data view */
+	inline std::string_view next_token(std::string_view& data) {
+		std::size_t start = data.find_first_not_of(" \t");
+
+		if (start == std::string_view::npos) {
+			data = {};
+			return {};
+		}
+
+		std::size_t end = data.find_first_of(" \t", start);
+		std::string_view token = data.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+
+		data.remove_prefix(start + token.length());
+
+		return token;
+	}
+
+	/* Rest of the line without leading whitespace */
+	inline std::string_view rest(std::string_view& data) {
+		std::size_t start = data.find_first_not_of(" \t");
+		std::string_view value = start == std::string_view::npos ? std::string_view{} : data.substr(start);
+
+		data = {};
+
+		return value;
+	}
+
+	/* Next null terminated field, bounded by the end of data */
+	inline std::string_view next_field(std::string_view& data) {
+		std::size_t nul = data.find('\0');
+		std::string_view field = data.substr(0, nul);
+
+		data.remove_prefix(nul == std::string_view::npos ? data.length() : nul + 1);
+
+		return field;
+	}
+
+	inline uint16_t read_u16(const char* data) {
+		return static_cast<uint16_t>((static_cast<uint8_t>(data[0]) << 8) | static_cast<uint8_t>(data[1]));
+	}
+}
+
+/* Parse the body of a message of type T, the message type is already consumed
+ * TCP: data is the line after the message name, without CRLF
+ * UDP: data is the whole datagram
+ */
+template <MsgType T, class Wire>
+int parse(std::string_view data, Message& msg) {
+	msg.type = T;
+	msg.status = NONE;
+
+	if constexpr (Wire::binary) {
+		msg.id = detail::read_u16(data.data() + 1);
+		msg.ref_id = msg.id;
+		data.remove_prefix(3);
+
+		if constexpr (Schema<T>::status) {
+			if (data.length() < 3 || static_cast<uint8_t>(data[0]) > 1) {
+				return MESSAGE_ERROR;
+			}
+
+			msg.status = data[0] ? OK : NOK;
+			msg.ref_id = detail::read_u16(data.data() + 1);
+			data.remove_prefix(3);
+		}
+	}
+	else {
+		if constexpr (Schema<T>::status) {
+			std::string_view status = detail::next_token(data);
+
+			if (iequals(status, "OK")) {
+				msg.status = OK;
+			}
+			else if (iequals(status, "NOK")) {
+				msg.status = NOK;
+			}
+			else {
+				return MESSAGE_ERROR;
+			}
+		}
+	}
+
+	for (std::size_t i = 0; i < Schema<T>::fields.size(); ++i) {
+		const Field& field = Schema<T>::fields[i];
+
+		if constexpr (Wire::binary) {
+			msg.fields[i] = detail::next_field(data);
+		}
+		else {
+			if (field.keyword != nullptr && !iequals(detail::next_token(data), field.keyword)) {
+				return MESSAGE_ERROR;
+			}
+
+			msg.fields[i] = field.charset == Charset::CONTENT ? detail::rest(data) : detail::next_token(data);
+		}
+
+		if (!valid(field, msg.fields[i])) {
+			return MESSAGE_ERROR;
+		}
+	}
+
+	return SUCCESS;
+}
+
+/* Parse a message of any type */
+template <class Wire>
+int parse(std::string_view data, Message& msg) {
+	if constexpr (Wire::binary) {
+		/* Minimum message size of 3 bytes - type and MessageID */
+		if (data.length() < 3) {
+			return MESSAGE_ERROR;
+		}
+
+		switch (static_cast<uint8_t>(data[0])) {
+			case CONFIRM: return parse<CONFIRM, Wire>(data, msg);
+			case REPLY:   return parse<REPLY, Wire>(data, msg);
+			case AUTH:    return parse<AUTH, Wire>(data, msg);
+			case JOIN:    return parse<JOIN, Wire>(data, msg);
+			case MSG:     return parse<MSG, Wire>(data, msg);
+			case PING:    return parse<PING, Wire>(data, msg);
+			case ERR:     return parse<ERR, Wire>(data, msg);
+			case BYE:     return parse<BYE, Wire>(data, msg);
+			default:      return MESSAGE_ERROR;
+		}
+	}
+	else {
+		std::string_view name = detail::next_token(data);
+
+		/* Dispatch on the first letter, then verify the whole (case insensitive) name */
+		switch (name.empty() ? '\0' : to_upper(name[0])) {
+			case 'R': return iequals(name, Schema<REPLY>::name) ? parse<REPLY, Wire>(data, msg) : MESSAGE_ERROR;
+			case 'A': return iequals(name, Schema<AUTH>::name)  ? parse<AUTH, Wire>(data, msg)  : MESSAGE_ERROR;
+			case 'J': return iequals(name, Schema<JOIN>::name)  ? parse<JOIN, Wire>(data, msg)  : MESSAGE_ERROR;
+			case 'M': return iequals(name, Schema<MSG>::name)   ? parse<MSG, Wire>(data, msg)   : MESSAGE_ERROR;
+			case 'E': return iequals(name, Schema<ERR>::name)   ? parse<ERR, Wire>(data, msg)   : MESSAGE_ERROR;
+			case 'B': return iequals(name, Schema<BYE>::name)   ? parse<BYE, Wire>(data, msg)   : MESSAGE_ERROR;
+			default:  return MESSAGE_ERROR;
+		}
+	}
+}
+
+/* Map a parsed server message onto the client Response */
+inline void to_response(const Message& msg, Response& response) {
+	response.type = msg.type;
+	response.status = msg.status;
+
+	switch (msg.type) {
+		case MSG:
+		case ERR:
+			response.dname = msg.fields[0];
+			response.content = msg.fields[1];
+			break;
+
+		case BYE:
+			response.dname = msg.fields[0];
+			response.content = {};
+			break;
+
+		case REPLY:
+			response.dname = {};
+			response.content = msg.fields[0];
+			break;
+
+		default:
+			response.dname = {};
+			response.content = {};
+			break;
+	}
+}
+
+}
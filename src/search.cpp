@@ -0,0 +1,304 @@
+#include "search.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+namespace {
+
+/* Default memory budget, MiB */
+constexpr std::size_t DEFAULT_BUDGET = 32;
+
+/* Saved index header */
+constexpr char MAGIC[4] = {'I', 'P', 'K', 'S'};
+constexpr uint32_t VERSION = 1;
+
+void put_varint(std::vector<uint8_t>& out, uint32_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+/* Decode a whole posting list */
+void decode(const std::vector<uint8_t>& deltas, std::vector<uint32_t>& ordinals) {
+	uint32_t ordinal = 0;
+
+	ordinals.clear();
+
+	for (std::size_t i = 0; i < deltas.size();) {
+		uint32_t delta = 0;
+
+		for (int shift = 0; i < deltas.size(); shift += 7) {
+			uint8_t byte = deltas[i++];
+
+			delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+
+			if ((byte & 0x80) == 0) {
+				break;
+			}
+		}
+
+		ordinal += delta;
+		ordinals.push_back(ordinal);
+	}
+}
+
+template <class T>
+void write_value(std::ofstream& out, const T& value) {
+	out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <class T>
+bool read_value(std::ifstream& in, T& value) {
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+}
+
+SearchIndex::SearchIndex(History& history)
+	: path{history.directory() + "/search"} {
+	const char* value = std::getenv("IPK25_SEARCH_BUDGET");
+	std::size_t mib = value != nullptr ? std::strtoul(value, nullptr, 10) : DEFAULT_BUDGET;
+
+	budget = std::max<std::size_t>(mib, 1) << 20;
+
+	/* A saved index ahead of the history belongs to a different store */
+	if (!load() || next > history.size()) {
+		postings.clear();
+		bytes = 0;
+		first = 0;
+		next = 0;
+	}
+
+	history.range(next, history.size(), [this](const History::Record& record) {
+		add(record.ordinal, record.content);
+	});
+}
+
+SearchIndex::~SearchIndex() {
+	if (dirty) {
+		save();
+	}
+}
+
+void SearchIndex::tokenize(std::string_view text, const std::function<void(std::string_view)>& emit) {
+	char token[MAX_TOKEN];
+	std::size_t length = 0;
+
+	/* ASCII letters and digits are folded, other bytes above 0x7f are kept as parts of words */
+	for (std::size_t i = 0; i <= text.length(); ++i) {
+		unsigned char c = i < text.length() ? text[i] : ' ';
+
+		if (std::isalnum(c) || c >= 0x80) {
+			if (length < MAX_TOKEN) {
+				token[length++] = std::tolower(c);
+			}
+		}
+		else if (length > 0) {
+			emit(std::string_view(token, length));
+			length = 0;
+		}
+	}
+}
+
+void SearchIndex::append(Posting& posting, uint32_t ordinal) {
+	std::size_t size = posting.deltas.size();
+
+	put_varint(posting.deltas, ordinal - posting.last);
+	posting.last = ordinal;
+	posting.count++;
+	bytes += posting.deltas.size() - size;
+}
+
+void SearchIndex::add(std::size_t ordinal, std::string_view content) {
+	if (ordinal == History::NONE || ordinal < next || ordinal > UINT32_MAX) {
+		return;
+	}
+
+	uint32_t id = static_cast<uint32_t>(ordinal);
+
+	tokenize(content, [this, id](std::string_view token) {
+		auto [it, inserted] = postings.try_emplace(std::string(token));
+
+		if (inserted) {
+			bytes += token.length() + TOKEN_OVERHEAD;
+		}
+		/* Repeated token in the same record */
+		else if (it->second.count > 0 && it->second.last == id) {
+			return;
+		}
+
+		append(it->second, id);
+	});
+
+	next = id + 1;
+	dirty = true;
+
+	if (bytes > budget) {
+		prune();
+	}
+}
+
+/* Drop the oldest half of the indexed records until a quarter of the budget is free */
+void SearchIndex::prune() {
+	std::vector<uint32_t> ordinals;
+
+	while (bytes > budget / 4 * 3 && first < next) {
+		uint32_t cutoff = first + (next - first + 1) / 2;
+
+		bytes = 0;
+
+		for (auto it = postings.begin(); it != postings.end();) {
+			Posting& posting = it->second;
+
+			decode(posting.deltas, ordinals);
+
+			auto keep = std::lower_bound(ordinals.begin(), ordinals.end(), cutoff);
+
+			if (keep == ordinals.end()) {
+				it = postings.erase(it);
+				continue;
+			}
+
+			posting = Posting{};
+
+			for (; keep != ordinals.end(); ++keep) {
+				append(posting, *keep);
+			}
+
+			posting.deltas.shrink_to_fit();
+			bytes += it->first.length() + TOKEN_OVERHEAD;
+			++it;
+		}
+
+		first = cutoff;
+	}
+
+	log("[SEARCH] index pruned to ordinals from ", first);
+}
+
+std::vector<std::size_t> SearchIndex::find(std::string_view query, std::size_t limit) const {
+	std::vector<const Posting*> terms;
+	bool missing = false;
+
+	tokenize(query, [&](std::string_view token) {
+		auto it = postings.find(std::string(token));
+
+		if (it == postings.end()) {
+			missing = true;
+		}
+		else {
+			terms.push_back(&it->second);
+		}
+	});
+
+	std::vector<std::size_t> result;
+
+	if (missing || terms.empty()) {
+		return result;
+	}
+
+	/* Intersect starting from the shortest list */
+	std::sort(terms.begin(), terms.end(), [](const Posting* a, const Posting* b) {
+		return a->count < b->count;
+	});
+
+	std::vector<uint32_t> matches, other, merged;
+
+	decode(terms[0]->deltas, matches);
+
+	for (std::size_t i = 1; i < terms.size() && !matches.empty(); ++i) {
+		decode(terms[i]->deltas, other);
+		merged.clear();
+		std::set_intersection(matches.begin(), matches.end(), other.begin(), other.end(), std::back_inserter(merged));
+		matches.swap(merged);
+	}
+
+	std::size_t skip = matches.size() > limit ? matches.size() - limit : 0;
+
+	result.assign(matches.begin() + skip, matches.end());
+
+	return result;
+}
+
+/**
+ *	Saved index layout, host byte order:
+ *	"IPKS" <version> <first> <next> <tokens>, then per token
+ *	<length:u8> <token> <last> <count> <size> <deltas>
+ */
+bool SearchIndex::load() {
+	std::ifstream in(path, std::ios::binary);
+	char magic[4];
+	uint32_t version, tokens;
+
+	if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+		return false;
+	}
+
+	if (!read_value(in, version) || version != VERSION || !read_value(in, first) || !read_value(in, next) || !read_value(in, tokens)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < tokens; ++i) {
+		uint8_t length;
+		char token[MAX_TOKEN];
+		uint32_t size;
+		Posting posting;
+
+		if (!read_value(in, length) || length > MAX_TOKEN || !in.read(token, length)) {
+			return false;
+		}
+
+		if (!read_value(in, posting.last) || !read_value(in, posting.count) || !read_value(in, size)) {
+			return false;
+		}
+
+		posting.deltas.resize(size);
+
+		if (!in.read(reinterpret_cast<char*>(posting.deltas.data()), size)) {
+			return false;
+		}
+
+		bytes += length + TOKEN_OVERHEAD + size;
+		postings.emplace(std::string(token, length), std::move(posting));
+	}
+
+	return true;
+}
+
+/* Replace atomically, a crash leaves the previous index which is then caught up */
+void SearchIndex::save() {
+	std::string tmp = path + "." + std::to_string(getpid());
+	std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+
+	out.write(MAGIC, sizeof(MAGIC));
+	write_value(out, VERSION);
+	write_value(out, first);
+	write_value(out, next);
+	write_value(out, static_cast<uint32_t>(postings.size()));
+
+	for (const auto& [token, posting] : postings) {
+		write_value(out, static_cast<uint8_t>(token.length()));
+		out.write(token.data(), token.length());
+		write_value(out, posting.last);
+		write_value(out, posting.count);
+		write_value(out, static_cast<uint32_t>(posting.deltas.size()));
+		out.write(reinterpret_cast<const char*>(posting.deltas.data()), posting.deltas.size());
+	}
+
+	out.close();
+
+	if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+		local_error("Unable to save the search index ", path);
+		std::remove(tmp.c_str());
+	}
+}
@@ -0,0 +1,64 @@
+/**
+ * @file: search.hpp
+ *
+ * Incremental inverted index over chat history records, used by /search.
+ * Tokens map to posting lists of history record ordinals, stored as varint deltas.
+ * Memory is bounded by IPK25_SEARCH_BUDGET (MiB, default 32), the oldest half of the
+ * indexed records is dropped when the budget is exceeded.
+ * The index is saved next to the history (<dir>/search) and caught up from it on startup.
+ */
+
+#pragma once
+
+#include "history.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class SearchIndex {
+	public:
+		/* Load the saved index of a history store and index the records appended since */
+		SearchIndex(History& history);
+		~SearchIndex();
+
+		/* Index one record */
+		void add(std::size_t ordinal, std::string_view content);
+
+		/* Ordinals of records containing every query term, ascending, at most limit newest ones */
+		std::vector<std::size_t> find(std::string_view query, std::size_t limit) const;
+
+		/* Split text into lowercase tokens */
+		static void tokenize(std::string_view text, const std::function<void(std::string_view)>& emit);
+
+	private:
+		/* Longest indexed token, longer ones are truncated */
+		static constexpr std::size_t MAX_TOKEN = 32;
+
+		/* Approximate per-token bookkeeping cost of the hash map */
+		static constexpr std::size_t TOKEN_OVERHEAD = 64;
+
+		struct Posting {
+			std::vector<uint8_t> deltas; // Varint encoded ordinal deltas, the first one from 0
+			uint32_t last = 0;           // Last ordinal in the list
+			uint32_t count = 0;          // Number of ordinals
+		};
+
+		std::unordered_map<std::string, Posting> postings;
+
+		std::string path;
+		std::size_t budget;
+		std::size_t bytes = 0;    // Approximate memory in use
+		uint32_t first = 0;       // Oldest indexed ordinal
+		uint32_t next = 0;        // Next ordinal to be indexed
+		bool dirty = false;
+
+		void append(Posting& posting, uint32_t ordinal);
+		void prune();
+		bool load();
+		void save();
+};
@@ -0,0 +1,68 @@
+#include "submit_queue.hpp"
+
+#include <cstdint>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+SubmitQueue::SubmitQueue()
+	: head{new Node}
+	, tail{head.load(std::memory_order_relaxed)}
+	, fd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+{}
+
+SubmitQueue::~SubmitQueue() {
+	std::string msg;
+
+	while (pop(msg));
+
+	delete tail;
+
+	if (fd != -1) {
+		close(fd);
+	}
+}
+
+int SubmitQueue::get_fd() const {
+	return fd;
+}
+
+void SubmitQueue::push(std::string msg) {
+	Node* node = new Node;
+	node->msg = std::move(msg);
+
+	Node* prev = head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+
+	/* Only the first message after a reset wakes the consumer */
+	if (!signalled.exchange(true, std::memory_order_acq_rel)) {
+		uint64_t one = 1;
+		[[maybe_unused]] ssize_t written = write(fd, &one, sizeof(one));
+	}
+}
+
+void SubmitQueue::reset() {
+	uint64_t value;
+	[[maybe_unused]] ssize_t result = read(fd, &value, sizeof(value));
+
+	/* Messages linked after this point signal again, the exchange acquires the ones linked before */
+	signalled.exchange(false, std::memory_order_acq_rel);
+}
+
+bool SubmitQueue::pop(std::string& msg) {
+	Node* next = tail->next.load(std::memory_order_acquire);
+
+	/* Empty, or a producer has swapped the head but not linked its node yet - it signals after linking */
+	if (next == nullptr) {
+		return false;
+	}
+
+	msg = std::move(next->msg);
+	delete tail;
+	tail = next;
+
+	return true;
+}
+
+bool SubmitQueue::empty() const {
+	return tail->next.load(std::memory_order_acquire) == nullptr;
+}
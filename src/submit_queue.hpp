@@ -0,0 +1,51 @@
+/**
+ * @file: submit_queue.hpp
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+/* Multi-producer single-consumer queue of serialized outbound messages
+ *
+ * Intrusive linked list with a stub node (Vyukov): push() is one atomic exchange and a store,
+ * without locks, from any thread. Only the I/O owner of the session pops, in submission order,
+ * so the transport assigns UDP message IDs in that order as it sends them.
+ * The eventfd becomes readable when the queue turns non-empty, one write per drained batch.
+ */
+class SubmitQueue {
+	public:
+		SubmitQueue();
+		~SubmitQueue();
+
+		SubmitQueue(const SubmitQueue&) = delete;
+		SubmitQueue& operator=(const SubmitQueue&) = delete;
+
+		/* Readable when messages were submitted, -1 if the eventfd could not be created */
+		int get_fd() const;
+
+		/* Any thread */
+		void push(std::string msg);
+
+		/* I/O owner only - rearm the eventfd before draining */
+		void reset();
+
+		/* I/O owner only - take the oldest message, false if the queue is (momentarily) empty */
+		bool pop(std::string& msg);
+
+		/* I/O owner only */
+		bool empty() const;
+
+	private:
+		struct Node {
+			std::atomic<Node*> next{nullptr};
+			std::string msg;
+		};
+
+		/* Producers swap the head, the consumer owns the tail - kept on separate cache lines */
+		alignas(64) std::atomic<Node*> head;
+		alignas(64) Node* tail;
+		std::atomic<bool> signalled{false};
+		int fd;
+};
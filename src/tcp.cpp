@@ -1,243 +1,336 @@
 #include "tcp.hpp"
+#include "alloc_stats.hpp"
 #include "protocol.hpp"
 #include "message.hpp"
 #include "error.hpp"
+#include "probe.hpp"
+#include "recorder.hpp"
+#include "schema.hpp"
 
 #include <cctype>
 #include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 /* TCP constructor */
 TCP::TCP(Config& config) : Protocol(config) {}
 
 /* Shutdown socket & connection properly */
 TCP::~TCP() {
-	shutdown(socket_fd, SHUT_RDWR);
+	cancel_attempts();
+
+	if (socket_fd >= 0) {
+		shutdown(socket_fd, SHUT_RDWR);
+	}
 }
 
-/* TCP connect - perform a TCP handshake with server */
-int TCP::connect() {	
-	if (::connect(socket_fd, (struct sockaddr *) &server_address, sizeof(server_address)) != 0 && errno != EINPROGRESS) {
-		local_error("TCP connect()");
+/* Begin a non-blocking handshake with one resolved address, re-arms the attempt delay timer */
+int TCP::start_attempt(std::size_t endpoint) {
+	const Endpoint& target = endpoints[endpoint];
+	int fd = open_socket(target.address.ss_family);
+
+	if (fd < 0) {
 		return NETWORK_ERROR;
 	}
 
-	return SUCCESS;
-}
+	if (::connect(fd, (struct sockaddr *) &target.address, target.length) != 0 && errno != EINPROGRESS) {
+		log("[TCP] connect() to ", address_string(target.address), " failed: ", errno);
+		close(fd);
+		return NETWORK_ERROR;
+	}
 
-/* TCP send - sends any defined type of message */
-int TCP::send(std::string msg) {
-	int b_tx = ::send(socket_fd, msg.c_str(), msg.length(), 0);
+	struct epoll_event event = {};
 
-	if (b_tx < 0) {
-		local_error("TCP send()");
+	event.events = EPOLLOUT;
+	event.data.fd = fd;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+		close(fd);
 		return NETWORK_ERROR;
 	}
 
+	struct itimerspec delay = {};
+
+	delay.it_value.tv_nsec = ATTEMPT_DELAY * 1000000L;
+	timerfd_settime(timer_fd, 0, &delay, nullptr);
+
+	log("[TCP] connecting to ", address_string(target.address));
+
+	attempts.push_back({fd, endpoint});
+
 	return SUCCESS;
 }
 
-/* TCP receive a message into a buffer */
-int TCP::receive() {
-	b_rx = recv(socket_fd, buffer + (segmentation ? offset_segment : 0), sizeof(buffer), 0);
+/* Check the attempts in flight, the first completed handshake becomes the connection */
+int TCP::poll_attempts() {
+	std::vector<struct pollfd> pfds;
 
-	if (b_rx <= 0) {
-		local_error("TCP receive()");
-		return NETWORK_ERROR;
+	for (const Attempt& attempt : attempts) {
+		pfds.push_back({attempt.fd, POLLOUT, 0});
 	}
 
-	return SUCCESS;
-}
+	if (poll(pfds.data(), pfds.size(), 0) < 0) {
+		return errno == EINTR ? TIMEOUT : NETWORK_ERROR;
+	}
 
-/* Extract TCP message content */
-int get_msg_content(std::istringstream& msgs, std::string& msg_content) {
-	std::string content;
+	for (std::size_t i = attempts.size(); i-- > 0;) {
+		if (pfds[i].revents == 0) {
+			continue;
+		}
+
+		int so_error = 0;
+		socklen_t len = sizeof(so_error);
+
+		if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &len) != 0 || so_error != 0) {
+			/* Refused or unreachable, drop this attempt */
+			log("[TCP] connect() to ", address_string(endpoints[attempts[i].endpoint].address), " failed: ", so_error);
+			close(attempts[i].fd);
+			attempts.erase(attempts.begin() + i);
+			continue;
+		}
 
-	std::getline(msgs >> std::ws, msg_content);
+		/* Winner */
+		const Endpoint& winner = endpoints[attempts[i].endpoint];
 
-	if (msg_content.back() == '\r') {
-		msg_content.pop_back();
+		socket_fd = attempts[i].fd;
+		server_address = winner.address;
+		server_address_len = winner.length;
+
+		attempts.erase(attempts.begin() + i);
+		cancel_attempts();
+
+		return SUCCESS;
 	}
 
-	if (msg_content.empty() || valid_printable_msg(msg_content) == false) {
-		local_error("Message contains invalid characters");
-		return MESSAGE_ERROR;
+	return TIMEOUT;
+}
+
+/* Abort the remaining attempts */
+void TCP::cancel_attempts() {
+	for (const Attempt& attempt : attempts) {
+		close(attempt.fd);
 	}
 
-	if (msg_content.length() > MAX_MSG_LEN) {
-		local_error("Message is too long");
-		return MESSAGE_ERROR;
+	attempts.clear();
+
+	if (epoll_fd >= 0) {
+		close(epoll_fd);
+		epoll_fd = -1;
 	}
 
-	return SUCCESS;
+	if (timer_fd >= 0) {
+		close(timer_fd);
+		timer_fd = -1;
+	}
 }
 
-/* Perform a check if the message contains CRLF end marker */
-bool crlf(std::string msg) {
-	return msg.find(CRLF) != std::string::npos; 
-}
+/**
+ * TCP connect - begin the TCP handshake with server
+ * Resolved addresses are raced (Happy Eyeballs), a new attempt starts every ATTEMPT_DELAY
+ * milliseconds or as soon as all attempts in flight have failed, see connect_poll
+ */
+int TCP::connect() {
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
 
-/* TCP message parse and process function */
-int TCP::process(Response& response) {
-	/* Temporary parse variables */
-	std::string msg(buffer, segmentation ? offset_segment + b_rx : b_rx); // Message buffer of string type, size depends on segmentation 
-	std::istringstream msgs(msg);                                         // Message string stream
-	std::string msg_type, component;                                      // Message type & tokens
-	std::string dname, status, msg_content, error;                        // Message content
-	
-	/* Segmantation/Fragmentation protection */
-	if (crlf(msg)) {
-		segmentation = false;
-		response.incomplete = false;
-		offset_segment = 0;
+	struct epoll_event event = {};
+
+	event.events = EPOLLIN;
+	event.data.fd = timer_fd;
 
+	if (epoll_fd < 0 || timer_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event) != 0) {
+		cancel_attempts();
+		local_error("TCP connect()");
+		return NETWORK_ERROR;
 	}
-	else {
-		segmentation = true;
-		response.incomplete = true;
-		offset_segment += b_rx;
-		
+
+	return connect_poll();
+}
+
+/* Advance the handshake, called whenever the handshake descriptor is ready */
+int TCP::connect_poll() {
+	int result = poll_attempts();
+
+	if (result == SUCCESS) {
+		log("[TCP] connected to ", address_string(server_address));
+		connected = true;
 		return SUCCESS;
 	}
 
-	/* Get message type */
-	msgs >> msg_type;
+	if (result != TIMEOUT) {
+		cancel_attempts();
+		local_error("TCP connect()");
+		return result;
+	}
 
-	/* ERR FROM {DisplayName} IS {MessageContent}\r\n */
-	if (str_up(msg_type) == "ERR") {
-		/* FROM */
-		msgs >> component;
+	/* Attempt delay elapsed, or every attempt in flight failed */
+	uint64_t expirations = 0;
+	bool elapsed = read(timer_fd, &expirations, sizeof(expirations)) > 0;
 
-		if (str_up(component) != "FROM") {
-			return MESSAGE_ERROR;
-		}
+	while (next_endpoint < endpoints.size() && (elapsed || attempts.empty())) {
+		elapsed = false;
+		start_attempt(next_endpoint++);
+	}
 
-		/* DisplayName */
-		msgs >> dname;
+	if (attempts.empty()) {
+		cancel_attempts();
+		local_error("TCP connect() - server unreachable");
+		return NETWORK_ERROR;
+	}
 
-		if (dname.empty() || valid_printable(dname) == false || dname.length() > MAX_DN_LEN) {
-			return MESSAGE_ERROR;
-		}
+	return SUCCESS;
+}
 
-		/* IS */
-		msgs >> component;
+/* Close the lost connection, the next connect races the resolved addresses again */
+int TCP::reset() {
+	cancel_attempts();
 
-		if (str_up(component) != "IS") {
-			return MESSAGE_ERROR;
-		}
+	if (socket_fd >= 0) {
+		close(socket_fd);
+		socket_fd = -1;
+	}
 
-		/* MessageContent */
-		if (get_msg_content(msgs, msg_content)) {
-			return MESSAGE_ERROR;
-		}
+	head = 0;
+	tail = 0;
+	next_endpoint = 0;
+
+	return SUCCESS;
+}
 
-		/* Process parsed ERR message */
-		response.content = "ERROR FROM " + dname + ": " + msg_content;
+/* Readable when an attempt completes or the next attempt is due */
+int TCP::handshake_fd() {
+	return epoll_fd;
+}
 
-		response.type = MsgType::ERR;
+/* Type of an outgoing TCP message, derived from its leading keyword */
+MsgType tcp_msg_type(std::string_view msg) {
+	switch (msg.empty() ? '\0' : msg[0]) {
+		case 'A': return AUTH;
+		case 'J': return JOIN;
+		case 'M': return MSG;
+		case 'E': return ERR;
+		case 'B': return BYE;
+		default: return UNKNOWN;
 	}
-	/* REPLY {"OK"|"NOK"} IS {MessageContent}\r\n */
-	else if (str_up(msg_type) == "REPLY") {
-		/* REPLY result OK | NOK */
-		msgs >> status;
+}
 
-		/* IS */
-		msgs >> component;
+/* TCP send - sends any defined type of message */
+int TCP::send(std::string msg) {
+	int b_tx = io_send(msg, nullptr, 0);
 
-		if (str_up(component) != "IS") {
-			return MESSAGE_ERROR;
-		}
+	if (b_tx < 0) {
+		local_error("TCP send()");
+		return NETWORK_ERROR;
+	}
 
-		/* MessageContent */
-		if (get_msg_content(msgs, msg_content)) {
-			return MESSAGE_ERROR;
-		}
+	recorder::record(RecEvent::SEND, tcp_msg_type(msg), 0, b_tx);
+	alloc_stats::account(alloc_stats::OUTBOUND, tcp_msg_type(msg));
 
-		/* Evaluate REPLY result */
-		if (str_up(status) == "OK") {
-			response.status = ResponseStatus::OK;
-			response.content = "Action Success: " + msg_content;
-		}
-		else if (str_up(status) == "NOK") {
-			response.status = ResponseStatus::NOK;
-			response.content = "Action Failure: " + msg_content;
-		}
-		else {
-			return MESSAGE_ERROR;
-		}
+	return SUCCESS;
+}
+
+/* TCP receive a message into a buffer */
+int TCP::receive() {
+	alloc_stats::mark();
 
-		/* Process parsed REPLY message */
-		response.type = MsgType::REPLY;
+	/* Move the unparsed rest to the front */
+	if (head > 0) {
+		std::memmove(buffer, buffer + head, tail - head);
+		tail -= head;
+		head = 0;
 	}
-	/* MSG FROM {DisplayName} IS {MessageContent}\r\n */
-	else if (str_up(msg_type) == "MSG") {
-		/* FROM */
-		msgs >> component;
 
-		if (str_up(component) != "FROM") {
-			return MESSAGE_ERROR;
-		}
+	b_rx = io_receive(buffer + tail, sizeof(buffer) - tail, nullptr, nullptr);
+
+	if (b_rx <= 0) {
+		local_error("TCP receive()");
+		return NETWORK_ERROR;
+	}
 
-		/* DisplayName */
-		msgs >> dname;
+	tail += b_rx;
 
-		if (dname.empty() || valid_printable(dname) == false || dname.length() > MAX_DN_LEN) {
-			return MESSAGE_ERROR;
-		}
+	PROBE(tcp_receive, b_rx, tail - head, 0);
 
-		/* IS */
-		msgs >> component;
+	return SUCCESS;
+}
 
-		if (str_up(component) != "IS") {
-			return MESSAGE_ERROR;
-		}
+bool TCP::pending() {
+	return std::string_view(buffer + head, tail - head).find(CRLF) != std::string_view::npos;
+}
 
-		/* MessageContent */
-		if (get_msg_content(msgs, msg_content)) {
-			return MESSAGE_ERROR;
-		}
+/* TCP message parse and process function, records the outcome */
+int TCP::process(Response& response) {
+	std::size_t start = head;
+	int result = parse(response);
 
-		/* Process parsed MSG message */
-		response.content = dname + ": " + msg_content;
-		
-		response.type = MsgType::MSG;
+	if (result) {
+		recorder::record(RecEvent::PARSE_FAIL, UNKNOWN, 0, b_rx);
+	}
+	else if (!response.incomplete) {
+		recorder::record(RecEvent::RECV, response.type, 0, b_rx);
+		alloc_stats::account(alloc_stats::INBOUND, response.type);
 	}
-	/* BYE FROM {DisplayName}\r\n */
-	else if (str_up(msg_type) == "BYE") {
-		/* FROM */
-		msgs >> component;
-
-		if (str_up(component) != "FROM") {
-			return MESSAGE_ERROR;
-		}
 
-		/* DisplayName */
-		msgs >> dname;
+	PROBE(tcp_process, response.type, head - start, 0);
 
-		if (dname.empty() || valid_printable(dname) == false || dname.length() > MAX_DN_LEN) {
-			return MESSAGE_ERROR;
-		}
+	return result;
+}
 
-		/* Process parsed BYE message */
-		response.type = MsgType::BYE;
+/* TCP message parser, takes the first complete message of the buffer
+ * Display name and content of the response are views into the receive buffer,
+ * valid until the next receive()
+ */
+int TCP::parse(Response& response) {
+	std::string_view msg(buffer + head, tail - head); // Unparsed data
+	std::size_t end = msg.find(CRLF);                 // End of the message
+	schema::Message parsed;
+	
+	/* Segmantation/Fragmentation protection */
+	if (end != std::string_view::npos) {
+		response.incomplete = false;
+		head += end + 2; // CRLF
 	}
-	/* Invalid message type */
 	else {
-		local_error("Invalid TCP server messsage");
+		response.incomplete = true;
+		
+		return SUCCESS;
+	}
 
+	/* Parse the message line without CRLF against the message schema */
+	if (schema::parse<schema::TcpWire>(msg.substr(0, end), parsed)) {
+		local_error("Malformed TCP server message");
 		return MESSAGE_ERROR;
 	}
 
+	/* Only ERR, REPLY, MSG and BYE are sent by the server */
+	switch (parsed.type) {
+		case ERR:
+		case REPLY:
+		case MSG:
+		case BYE:
+			schema::to_response(parsed, response);
+			break;
+
+		default:
+			local_error("Invalid TCP server messsage");
+			return MESSAGE_ERROR;
+	}
+
 	return SUCCESS;
 }
 
 /* TCP error message send function */
 int TCP::error(std::string error) {
-	if (send(error)) {
+	if (send(std::move(error))) {
 		return NETWORK_ERROR;
 	}
 
@@ -245,7 +338,7 @@ int TCP::error(std::string error) {
 }
 
 /* TCP direct disconnect function, send BYE message  */
-int TCP::disconnect(std::string id) {
+int TCP::disconnect(std::string_view id) {
 	if (send(msg_factory->create_bye_msg(id))) {
 		return NETWORK_ERROR;
 	}
@@ -3,20 +3,55 @@
 #include "protocol.hpp"
 #include "config.hpp"
 
-class TCP : public Protocol {
+#include <cstddef>
+#include <vector>
+
+class TCP final : public Protocol {
 	public:
+		using Factory = TCPMsgFactory;
+
 		TCP(Config& config);
 		~TCP();
 
 		/* Transport protocol overriden methods */
 		int connect() override;
+		int connect_poll() override;
+		int handshake_fd() override;
 		int send(std::string msg) override;
 		int receive() override;
 		int process(Response& response) override;
 		int error(std::string err) override;
-		int disconnect(std::string id) override;
+		int disconnect(std::string_view id) override;
+		int reset() override;
+
+		/* Message parser */
+		int parse(Response& response);
+
+		/* Complete messages left in the buffer by the last receive */
+		bool pending() override;
+
+		/* Unparsed data, buffer[head, tail), may hold several messages or a partial one */
+		std::size_t head = 0;
+		std::size_t tail = 0;
+
+	private:
+		/* Happy Eyeballs (RFC 8305) connection attempt in flight */
+		struct Attempt {
+			int fd;
+			std::size_t endpoint;
+		};
+
+		/* Delay between starting connection attempts, milliseconds */
+		static constexpr int ATTEMPT_DELAY = 250;
+
+		std::vector<Attempt> attempts;
+		std::size_t next_endpoint = 0;
+
+		/* Attempt sockets and the attempt delay timer, polled through one descriptor */
+		int epoll_fd = -1;
+		int timer_fd = -1;
 
-		/* Segmentation */
-		int offset_segment = 0;
-		bool segmentation = false;
+		int start_attempt(std::size_t endpoint);
+		int poll_attempts();
+		void cancel_attempts();
 };
\ No newline at end of file
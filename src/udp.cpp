@@ -1,20 +1,32 @@
 #include "udp.hpp"
-#include "client.hpp"
+#include "alloc_stats.hpp"
 #include "error.hpp"
 #include "message.hpp"
+#include "probe.hpp"
 #include "protocol.hpp"
+#include "recorder.hpp"
+#include "schema.hpp"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <netinet/in.h>
 #include <string>
+#include <utility>
+#include <string_view>
 #include <sys/socket.h>
 
 UDP::UDP(Config& config)
 	: Protocol(config)
-	, message_id{0}
+	, udp_timeout{config.udp_timeout}
 	, retransmission{config.udp_retransmission}
-	, udp_timeout{config.udp_timeout} {}
+	, message_id{0}
+	, endpoint{0}
+	, tried{1}
+	, answered{false}
+	, stray{false}
+	, in_flight{false}
+	, retries{0} {}
 
 UDP::~UDP() {
 	//log("[UDP] BYE");
@@ -23,9 +35,32 @@ UDP::~UDP() {
 /* Empty, UDP has no connection */
 int UDP::connect() { 
 	//log("[UDP] connect()");
+	connected = true;
 	return SUCCESS; 
 }
 
+/* New session from a new source port, back to the first address and the server's listening port */
+int UDP::reset() {
+	message_id = 0;
+	msg_set.clear();
+	endpoint = 0;
+	tried = 1;
+	answered = false;
+	requests.clear();
+	posted.clear();
+	in_flight = false;
+
+	server_address = endpoints.front().address;
+	server_address_len = endpoints.front().length;
+
+	if (create_socket(server_address.ss_family)) {
+		local_error("Failed to create a socket");
+		return NETWORK_ERROR;
+	}
+
+	return SUCCESS;
+}
+
 /* MessageID assignment */
 void bind_msg_id(std::string& msg, uint16_t msg_id) {
 	uint16_t big_end_msg_id = htons(msg_id);
@@ -36,15 +71,52 @@ void bind_msg_id(std::string& msg, uint16_t msg_id) {
 	}
 }
 
+/* Extract ID from a message */
+uint16_t get_msg_id(const char* buffer) {
+	uint16_t msg_id = *reinterpret_cast<const uint16_t*>(buffer);
+
+	return ntohs(msg_id);
+}
+
+/* Next message ID, a request is remembered for the check of its REPLY */
+void UDP::stamp(std::string& msg) {
+	bind_msg_id(msg, message_id);
+
+	if (static_cast<uint8_t>(msg[0]) == AUTH || static_cast<uint8_t>(msg[0]) == JOIN) {
+		requests.push_back(message_id);
+	}
+}
+
 /* Directly send once */
-int UDP::direct_send(std::string msg) {
-	int b_tx = sendto(socket_fd, msg.c_str(), msg.length(), 0, (struct sockaddr *) &server_address, sizeof(server_address));
+int UDP::direct_send(const std::string& msg) {
+	int b_tx = io_send(msg, (struct sockaddr *) &server_address, server_address_len);
 
 	if (b_tx < 0) {
 		local_error("[UDP] send()");
 		return NETWORK_ERROR;
 	}
 
+	recorder::record(RecEvent::SEND, msg[0], get_msg_id(msg.data() + 1), b_tx);
+
+	return SUCCESS;
+}
+
+/* Switch to the next resolved server address, reopens the socket on a family change */
+int UDP::next_endpoint() {
+	endpoint = (endpoint + 1) % endpoints.size();
+	tried = std::min(tried + 1, endpoints.size());
+
+	const Endpoint& next = endpoints[endpoint];
+
+	if (next.address.ss_family != server_address.ss_family && create_socket(next.address.ss_family)) {
+		return NETWORK_ERROR;
+	}
+
+	server_address = next.address;
+	server_address_len = next.length;
+
+	log("[UDP] trying ", address_string(server_address));
+
 	return SUCCESS;
 }
 
@@ -52,9 +124,29 @@ int UDP::direct_send(std::string msg) {
 int UDP::send(std::string msg) {
 	int retransmission = UDP::retransmission, await_result;
 	Response response = {.type = UNKNOWN, .status = NONE, .duplicate = false};
-	bind_msg_id(msg, message_id);
+
+	/* Posted datagrams are abandoned, an unconfirmed one keeps its ID */
+	if (in_flight) {
+		++message_id;
+		in_flight = false;
+	}
+
+	posted.clear();
+	stamp(msg);
+
+	alloc_stats::account(alloc_stats::OUTBOUND, msg[0]);
 
 	do {
+		if (retransmission != UDP::retransmission) {
+			recorder::record(RecEvent::RETRANSMIT, msg[0], message_id, msg.length());
+			PROBE(udp_retransmit, msg[0], msg.length(), message_id);
+
+			/* No answer from the server yet, retransmit to its next address */
+			if (!answered && endpoints.size() > 1 && next_endpoint()) {
+				return NETWORK_ERROR;
+			}
+		}
+
 		if (direct_send(msg)) {
 			return NETWORK_ERROR;
 		}
@@ -74,74 +166,180 @@ int UDP::send(std::string msg) {
 	return await_result;
 }
 
-/* UDP receive */
-int UDP::receive() {
-	struct sockaddr_in src {};
-	socklen_t addr_len = sizeof(struct sockaddr_in);
+/* Queue a datagram for transmit() */
+void UDP::post(std::string msg) {
+	posted.push_back(std::move(msg));
+}
+
+/* Send the next posted datagram unless one is in flight */
+int UDP::transmit() {
+	if (in_flight || posted.empty()) {
+		return SUCCESS;
+	}
+
+	std::string& msg = posted.front();
+
+	stamp(msg);
+	alloc_stats::account(alloc_stats::OUTBOUND, msg[0]);
+
+	if (direct_send(msg)) {
+		return NETWORK_ERROR;
+	}
 
-	b_rx = recvfrom(socket_fd, buffer, sizeof(buffer), 0, (struct sockaddr *) &src, &addr_len);
+	in_flight = true;
+	retries = 0;
+	deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(udp_timeout);
 
-	/* Verify IP address */
-	if (memcmp(&server_address.sin_addr, &src.sin_addr, sizeof(struct in_addr)) != 0) {
-		local_error("[UDP] received packet from wrong IPv4 address");
-		std::cerr << (int)  server_address.sin_addr.s_addr << " - " << (int) src.sin_addr.s_addr << std::endl;
-		return ADDRESS_ERROR;
+	return SUCCESS;
+}
+
+/* Resend the datagram in flight once its CONFIRM is overdue, TIMEOUT drops it when the retransmissions run out */
+int UDP::retransmit() {
+	auto now = std::chrono::steady_clock::now();
+
+	if (!in_flight || now < deadline) {
+		return SUCCESS;
+	}
+
+	const std::string& msg = posted.front();
+
+	if (retries >= retransmission) {
+		local_error("[UDP] message ", message_id, " not confirmed");
+		posted.pop_front();
+		in_flight = false;
+		++message_id;
+		return TIMEOUT;
+	}
+
+	recorder::record(RecEvent::RETRANSMIT, msg[0], message_id, msg.length());
+	PROBE(udp_retransmit, msg[0], msg.length(), message_id);
+
+	/* No answer from the server yet, retransmit to its next address */
+	if (!answered && endpoints.size() > 1 && next_endpoint()) {
+		return NETWORK_ERROR;
+	}
+
+	if (direct_send(msg)) {
+		return NETWORK_ERROR;
 	}
 
-	/* Acquirement of dynamic port */
-	server_address.sin_port = src.sin_port;
+	++retries;
+	deadline = now + std::chrono::milliseconds(udp_timeout);
+
+	return SUCCESS;
+}
+
+/* Milliseconds until retransmit() is due, -1 when nothing is in flight */
+int UDP::next_timeout() const {
+	if (!in_flight) {
+		return -1;
+	}
+
+	auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+
+	return std::max<int>(0, left.count());
+}
+
+/* UDP receive */
+int UDP::receive() {
+	struct sockaddr_storage src {};
+	socklen_t addr_len = sizeof(src);
+
+	alloc_stats::mark();
+
+	b_rx = io_receive(buffer, sizeof(buffer), &src, &addr_len);
 
 	if (b_rx < 0) {
 		local_error("[UDP] receive()");
 		return 1;
 	}
 
+	/* Verify IP address, a datagram of any other host is dropped and the client keeps waiting */
+	stray = !same_host(server_address, src) && !settle(src);
+
+	if (stray) {
+		log("[UDP] dropped a datagram from ", address_string(src), " - expected ", address_string(server_address));
+		return SUCCESS;
+	}
+
+	/* Acquirement of dynamic port (the reply socket address on Unix sockets), the server address is settled */
+	if (src.ss_family == AF_UNIX) {
+		server_address = src;
+		server_address_len = addr_len;
+	}
+	else {
+		set_port(server_address, get_port(src));
+	}
+
+	answered = true;
+
+	PROBE(udp_receive, b_rx >= 3 ? static_cast<uint8_t>(buffer[0]) : UNKNOWN, b_rx, b_rx >= 3 ? get_msg_id(buffer + 1) : 0);
+
 	//log("Bytes rx: " + std::to_string(b_rx));
 
 	return 0;
 }
 
-/* Extract ID from a message */
-uint16_t get_msg_id(char* buffer) {
-	uint16_t msg_id = *reinterpret_cast<uint16_t*>(buffer);
+/* Late reply from an address tried earlier in the unanswered send, the server is settled on it */
+bool UDP::settle(const struct sockaddr_storage& src) {
+	if (answered) {
+		return false;
+	}
 
-	return ntohs(msg_id);
-}
+	for (std::size_t i = 0; i < tried; ++i) {
+		if (same_host(endpoints[i].address, src)) {
+			endpoint = i;
+			server_address = endpoints[i].address;
+			server_address_len = endpoints[i].length;
 
-int get_msg_content(char* msg_bp, std::string& content) {
-	std::string dname, msg_content;
+			log("[UDP] settled on ", address_string(server_address));
 
-	dname = std::string(msg_bp);
-	
-	msg_bp += dname.length() + 1;
+			return true;
+		}
+	}
 
-	msg_content = std::string(msg_bp);
+	return false;
+}
 
-	if (dname.empty() || msg_content.empty()) {
-		local_error("Message contents empty");
-		return MESSAGE_ERROR;
+/* UDP message parse and process function, records the outcome */
+int UDP::process(Response& response) {
+	/* Dropped by receive, skipped like a duplicate */
+	if (stray) {
+		response.duplicate = true;
+		return SUCCESS;
 	}
 
-	content = dname + ": " + msg_content;
+	int result = parse(response);
 
-	if (valid_printable(dname) == false || dname.length() > MAX_DN_LEN) {
-		local_error("Display name invalid");
-		return MESSAGE_ERROR;
+	if (result) {
+		recorder::record(RecEvent::PARSE_FAIL, b_rx > 0 ? buffer[0] : UNKNOWN, b_rx >= 3 ? get_msg_id(buffer + 1) : 0, b_rx);
 	}
-
-	if (valid_printable_msg(msg_content) == false || msg_content.length() > MAX_MSG_LEN) {
-		local_error("Message content invalid");
-		return MESSAGE_ERROR;
+	else if (response.type == CONFIRM && !response.duplicate) {
+		recorder::record(RecEvent::CONFIRM, CONFIRM, get_msg_id(buffer + 1), b_rx);
+		alloc_stats::account(alloc_stats::INBOUND, CONFIRM);
+
+		/* Posted datagram delivered, the next one may go */
+		if (in_flight) {
+			posted.pop_front();
+			in_flight = false;
+			++message_id;
+		}
+	}
+	else if (!response.duplicate) {
+		recorder::record(RecEvent::RECV, response.type, get_msg_id(buffer + 1), b_rx);
+		alloc_stats::account(alloc_stats::INBOUND, response.type);
 	}
 
-	return SUCCESS;
+	PROBE(udp_process, response.type, b_rx, b_rx >= 3 ? get_msg_id(buffer + 1) : 0);
+
+	return result;
 }
 
-/* UDP message parse and process function */
-int UDP::process(Response& response) {
+/* UDP message parser */
+int UDP::parse(Response& response) {
 	uint8_t msg_type;
-	uint16_t ref_message_id, server_msg_id;
-	std::string msg_content;
+	uint16_t server_msg_id;
+	schema::Message parsed;
 
 	/* Minimum response size of 3 bytes */
 	if (b_rx < 3) {
@@ -172,84 +370,49 @@ int UDP::process(Response& response) {
 		msg_set.insert(server_msg_id);
 	}
 
-	switch (msg_type) {
+	/* Parse the datagram against the message schema */
+	if (schema::parse<schema::UdpWire>(std::string_view(buffer, b_rx), parsed)) {
+		local_error("Malformed UDP server message: ", msg_type);
+		response.type = UNKNOWN;
+		return MESSAGE_ERROR;
+	}
+
+	switch (parsed.type) {
 		case CONFIRM: {
-			/* Get reference message id */
-			ref_message_id = get_msg_id(buffer + 1);
+			/* Second CONFIRM of a retransmitted message, skipped */
+			response.duplicate = parsed.ref_id == static_cast<uint16_t>(message_id - 1);
 
 			/* Reference msg id must correspond to client side sent msg id */
-			if (ref_message_id != message_id) {
+			if (parsed.ref_id != message_id && !response.duplicate) {
 				local_error("Confirm response to invalid client message ID");
 				return PROTOCOL_ERROR;
 			}
 
-			response.type = CONFIRM;
 			break;
 		}
 
 		case REPLY: {
-			/* Get reply result - OK | NOK */
-			int result = buffer[3];
-
-			/* Get reference message id */
-			ref_message_id = get_msg_id(buffer + 4);
+			/* Reference msg id must correspond to a client request, requests left unanswered before it are dropped */
+			auto request = std::find(requests.begin(), requests.end(), parsed.ref_id);
 
-			/* Atleast 5 bytes must be received for REPLY to be valid */
-			if (b_rx < 5 || result < 0 || result > 1) {
-				local_error("Invalid reply result or integrity");
-				return PROTOCOL_ERROR;
-			}
-
-			/* Reference msg id must correspond to client side sent msg id */
-			if (ref_message_id != (message_id - 1)) { // (message id - 1) because the variable is incremented after each sucessful send()
+			if (request == requests.end()) {
 				local_error("Reply to invalid client message ID");
 				return PROTOCOL_ERROR;
 			}
 
-			response.status = result ? OK : NOK;
+			requests.erase(requests.begin(), request + 1);
 
-			std::string content(buffer + 6);
-
-			response.content = (result ? "Action Success: " : "Action Failure: ") + content;
-
-			response.type = REPLY;
 			break;
 		}
 
-		case MSG: {
-			if (get_msg_content(buffer + 3, msg_content)) {
-				return MESSAGE_ERROR;
-			}
-
-			response.content = msg_content;
-			response.type = MSG;
+		case MSG:
+		case ERR:
+		case BYE:
+		case PING:
 			break;
-		}
-
-		case ERR: {
-			if (get_msg_content(buffer + 3, msg_content)) {
-				return MESSAGE_ERROR;
-			}
-
-			response.content = "ERROR FROM " + msg_content;
-			response.type = ERR;
-			break;
-		}
-
-		case BYE: {
-			response.type = BYE;
-
-			break;
-		}
-
-		case PING: {
-			response.type = PING;
-
-			break;
-		}
 
 		default: {
-			local_error("Invalid UDP server message: " + std::to_string(msg_type));
+			local_error("Invalid UDP server message: ", msg_type);
 
 			response.type = UNKNOWN;
 
@@ -257,12 +420,14 @@ int UDP::process(Response& response) {
 		}
 	}
 
+	schema::to_response(parsed, response);
+
 	return SUCCESS;
 }
 
 /* UDP error function - sends ERR msg to server */
 int UDP::error(std::string error) {
-	if (send(error)) {
+	if (send(std::move(error))) {
 		return PROTOCOL_ERROR;
 	}
 
@@ -270,7 +435,7 @@ int UDP::error(std::string error) {
 }
 
 /* UDP disconnect function - sends BYE msg to server */
-int UDP::disconnect(std::string id) {
+int UDP::disconnect(std::string_view id) {
 	if (send(msg_factory->create_bye_msg(id))) {
 		return PROTOCOL_ERROR;
 	}
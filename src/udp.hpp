@@ -2,11 +2,16 @@
 
 #include "protocol.hpp"
 #include "config.hpp"
+#include <chrono>
 #include <cstdint>
+#include <deque>
+#include <string>
 #include <unordered_set>
 
-class UDP : public Protocol {
+class UDP final : public Protocol {
 	public:
+		using Factory = UDPMsgFactory;
+
 		UDP(Config& config);
 		~UDP();	
 
@@ -15,7 +20,16 @@ class UDP : public Protocol {
 		int receive() override;
 		int process(Response& response) override;
 		int error(std::string err) override;
-		int disconnect(std::string id) override;
+		int disconnect(std::string_view id) override;
+		int reset() override;
+
+		/* Non-blocking sends for event loops: one datagram is in flight until process() sees its CONFIRM,
+		 * the caller transmits the next one and retransmits at next_timeout(). A blocking send abandons them.
+		 */
+		void post(std::string msg);
+		int transmit();
+		int retransmit();
+		int next_timeout() const;
 
 	private:
 		uint16_t udp_timeout;
@@ -24,7 +38,29 @@ class UDP : public Protocol {
 		uint16_t message_id;
 		std::unordered_set<uint16_t> msg_set;
 
+		/* Resolved address in use, locked once the server answers */
+		std::size_t endpoint;
+		std::size_t tried; // Addresses tried so far, endpoints[0, tried)
+		bool answered;
+
+		/* Last received datagram came from another host */
+		bool stray;
+
+		/* IDs of AUTH and JOIN requests awaiting their REPLY, posted ones may be answered after later sends */
+		std::deque<uint16_t> requests;
+
+		/* Posted datagrams, the first one is in flight */
+		std::deque<std::string> posted;
+		bool in_flight;
+		int retries;
+		std::chrono::steady_clock::time_point deadline;
+
+		int next_endpoint();
+		bool settle(const struct sockaddr_storage& src);
+
+		int parse(Response& response);
 		void assign_message_id(uint16_t message_id);
-		int direct_send(std::string msg);
+		void stamp(std::string& msg);
+		int direct_send(const std::string& msg);
 		int confirm(uint16_t message_id);
 };
\ No newline at end of file
@@ -0,0 +1,480 @@
+#include "uring.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+/* Ring sizes */
+constexpr unsigned RX_ENTRIES = 16;           // Provided receive buffers, power of two
+constexpr std::size_t RX_BUFFER_SIZE = 65536 + 256; // Datagram with recvmsg header and source address
+constexpr std::size_t TX_BUFFER_SIZE = 65536;
+constexpr uint16_t BUFFER_GROUP = 0;
+
+/* Completion tags */
+constexpr uint64_t RECV_TAG = 1;
+constexpr uint64_t SEND_TAG = 2;
+
+int uring_setup(unsigned entries, struct io_uring_params* params) {
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int uring_enter(int fd, unsigned submit, unsigned complete, unsigned flags) {
+	return syscall(__NR_io_uring_enter, fd, submit, complete, flags, nullptr, 0);
+}
+
+int uring_register(int fd, unsigned opcode, void* arg, unsigned count) {
+	return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+}
+
+struct Uring::Ring {
+	int fd = -1;
+
+	void* sq_map = MAP_FAILED;
+	void* cq_map = MAP_FAILED;
+	std::size_t sq_size = 0, cq_size = 0;
+
+	struct io_uring_sqe* sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+	std::size_t sqes_size = 0;
+
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned sq_entries, sq_pending;
+
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe* cqes;
+
+	bool setup(unsigned entries) {
+		struct io_uring_params params = {};
+
+		if ((fd = uring_setup(entries, &params)) < 0) {
+			return false;
+		}
+
+		sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+		/* Both queues share one mapping on current kernels */
+		if (params.features & IORING_FEAT_SINGLE_MMAP) {
+			sq_size = cq_size = std::max(sq_size, cq_size);
+		}
+
+		sq_map = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+		if (sq_map == MAP_FAILED) {
+			return false;
+		}
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP) {
+			cq_map = sq_map;
+		}
+		else if ((cq_map = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+			return false;
+		}
+
+		sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+		sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+
+		if (sqes == MAP_FAILED) {
+			return false;
+		}
+
+		char* sq = static_cast<char*>(sq_map);
+		char* cq = static_cast<char*>(cq_map);
+
+		sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		sq_entries = params.sq_entries;
+		sq_pending = *sq_tail;
+
+		cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		return true;
+	}
+
+	~Ring() {
+		if (sqes != MAP_FAILED) {
+			munmap(sqes, sqes_size);
+		}
+
+		if (cq_map != MAP_FAILED && cq_map != sq_map) {
+			munmap(cq_map, cq_size);
+		}
+
+		if (sq_map != MAP_FAILED) {
+			munmap(sq_map, sq_size);
+		}
+
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	/* Zeroed submission entry, published by submit() */
+	struct io_uring_sqe* get_sqe() {
+		if (sq_pending - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+			return nullptr;
+		}
+
+		unsigned index = sq_pending++ & *sq_mask;
+		struct io_uring_sqe* sqe = &sqes[index];
+
+		sq_array[index] = index;
+		std::memset(sqe, 0, sizeof(*sqe));
+
+		return sqe;
+	}
+
+	/* Submit the prepared entries, optionally waiting for completions */
+	int submit(unsigned wait) {
+		unsigned count = sq_pending - *sq_tail;
+		int result;
+
+		__atomic_store_n(sq_tail, sq_pending, __ATOMIC_RELEASE);
+
+		do {
+			result = uring_enter(fd, count, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+		} while (result < 0 && errno == EINTR);
+
+		return result;
+	}
+
+	/* Consume the next completion */
+	bool peek(struct io_uring_cqe& cqe) {
+		unsigned head = *cq_head;
+
+		if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+			return false;
+		}
+
+		cqe = cqes[head & *cq_mask];
+		__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+
+		return true;
+	}
+};
+
+Uring::Uring()
+	: rx{std::make_unique<Ring>()}
+	, tx{std::make_unique<Ring>()}
+	, buf_ring{static_cast<struct io_uring_buf_ring*>(MAP_FAILED)}
+	, rx_buffers{static_cast<char*>(MAP_FAILED)}
+	, tx_buffer{static_cast<char*>(MAP_FAILED)}
+	, socket{-1}
+	, datagram{false}
+	, armed{false}
+	, rx_msg{} {}
+
+Uring::~Uring() {
+	disarm();
+
+	/* Rings first, they hold references to the buffers */
+	rx.reset();
+	tx.reset();
+
+	if (buf_ring != MAP_FAILED) {
+		munmap(buf_ring, RX_ENTRIES * sizeof(struct io_uring_buf));
+	}
+
+	if (rx_buffers != MAP_FAILED) {
+		munmap(rx_buffers, RX_ENTRIES * RX_BUFFER_SIZE);
+	}
+
+	if (tx_buffer != MAP_FAILED) {
+		munmap(tx_buffer, TX_BUFFER_SIZE);
+	}
+}
+
+std::unique_ptr<Uring> Uring::create() {
+	std::unique_ptr<Uring> uring(new Uring());
+
+	if (!uring->rx->setup(8) || !uring->tx->setup(4)) {
+		log("[URING] io_uring_setup() failed: ", errno);
+		return nullptr;
+	}
+
+	/* Provided buffer ring for the multishot receive */
+	void* ring = mmap(nullptr, RX_ENTRIES * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	void* buffers = mmap(nullptr, RX_ENTRIES * RX_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	void* send_buffer = mmap(nullptr, TX_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	uring->buf_ring = static_cast<struct io_uring_buf_ring*>(ring);
+	uring->rx_buffers = static_cast<char*>(buffers);
+	uring->tx_buffer = static_cast<char*>(send_buffer);
+
+	if (ring == MAP_FAILED || buffers == MAP_FAILED || send_buffer == MAP_FAILED) {
+		return nullptr;
+	}
+
+	struct io_uring_buf_reg reg = {};
+
+	reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+	reg.ring_entries = RX_ENTRIES;
+	reg.bgid = BUFFER_GROUP;
+
+	if (uring_register(uring->rx->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+		log("[URING] buffer ring registration failed: ", errno);
+		return nullptr;
+	}
+
+	for (unsigned bid = 0; bid < RX_ENTRIES; ++bid) {
+		uring->provide(bid);
+	}
+
+	/* Multishot receive support check on a local socket pair */
+	int pair[2];
+	char probe = 0;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, pair) != 0) {
+		return nullptr;
+	}
+
+	bool supported = uring->arm(pair[0], false) == SUCCESS
+		&& write(pair[1], &probe, 1) == 1
+		&& uring->receive(&probe, 1, nullptr, nullptr) == 1
+		&& uring->armed;
+
+	uring->disarm();
+	close(pair[0]);
+	close(pair[1]);
+
+	if (!supported) {
+		log("[URING] multishot receive not supported");
+		return nullptr;
+	}
+
+	return uring;
+}
+
+int Uring::get_fd() const {
+	return rx->fd;
+}
+
+/* Hand a receive buffer back to the kernel */
+void Uring::provide(unsigned short bid) {
+	/* Entries indexed from the ring start, the header's flexible bufs member is misplaced in C++ */
+	unsigned short tail = buf_ring->tail;
+	struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(buf_ring) + (tail & (RX_ENTRIES - 1));
+
+	buf->addr = reinterpret_cast<uint64_t>(rx_buffers + bid * RX_BUFFER_SIZE);
+	buf->len = RX_BUFFER_SIZE;
+	buf->bid = bid;
+
+	__atomic_store_n(&buf_ring->tail, static_cast<unsigned short>(tail + 1), __ATOMIC_RELEASE);
+}
+
+int Uring::submit_receive() {
+	struct io_uring_sqe* sqe = rx->get_sqe();
+
+	if (sqe == nullptr) {
+		return NETWORK_ERROR;
+	}
+
+	if (datagram) {
+		/* Source address and payload are laid out in the selected buffer */
+		rx_msg = {};
+		rx_msg.msg_namelen = sizeof(struct sockaddr_storage);
+
+		sqe->opcode = IORING_OP_RECVMSG;
+		sqe->addr = reinterpret_cast<uint64_t>(&rx_msg);
+		sqe->len = 1;
+	}
+	else {
+		sqe->opcode = IORING_OP_RECV;
+	}
+
+	sqe->fd = socket;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BUFFER_GROUP;
+	sqe->user_data = RECV_TAG;
+
+	if (rx->submit(0) < 0) {
+		return NETWORK_ERROR;
+	}
+
+	armed = true;
+
+	return SUCCESS;
+}
+
+int Uring::arm(int socket, bool datagram) {
+	disarm();
+
+	this->socket = socket;
+	this->datagram = datagram;
+
+	return submit_receive();
+}
+
+void Uring::disarm() {
+	if (!armed || rx == nullptr) {
+		return;
+	}
+
+	struct io_uring_sync_cancel_reg reg = {};
+
+	reg.addr = RECV_TAG;
+	reg.fd = -1;
+	reg.timeout.tv_sec = -1;
+	reg.timeout.tv_nsec = -1;
+
+	uring_register(rx->fd, IORING_REGISTER_SYNC_CANCEL, &reg, 1);
+
+	/* Drop the completions left behind, their buffers go back to the ring */
+	struct io_uring_cqe cqe;
+
+	while (rx->peek(cqe)) {
+		if (cqe.flags & IORING_CQE_F_BUFFER) {
+			provide(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+		}
+	}
+
+	armed = false;
+}
+
+ssize_t Uring::receive(char* dst, std::size_t cap, struct sockaddr_storage* src, socklen_t* src_len) {
+	struct io_uring_cqe cqe;
+
+	while (true) {
+		if (!rx->peek(cqe)) {
+			/* Readiness without a completion, wait for it */
+			if (rx->submit(1) < 0) {
+				return -1;
+			}
+
+			continue;
+		}
+
+		if (cqe.user_data != RECV_TAG) {
+			continue;
+		}
+
+		if (!(cqe.flags & IORING_CQE_F_MORE)) {
+			armed = false;
+		}
+
+		if (cqe.res < 0) {
+			/* Out of buffers ends the multishot receive, the data is still queued on the socket */
+			if (cqe.res == -ENOBUFS && submit_receive() == SUCCESS) {
+				continue;
+			}
+
+			errno = -cqe.res;
+			return -1;
+		}
+
+		/* Stream end */
+		if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+			return 0;
+		}
+
+		unsigned short bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		char* data = rx_buffers + bid * RX_BUFFER_SIZE;
+		std::size_t len = cqe.res;
+
+		if (datagram) {
+			auto* out = reinterpret_cast<struct io_uring_recvmsg_out*>(data);
+			char* name = data + sizeof(*out);
+
+			if (src != nullptr) {
+				std::memcpy(src, name, std::min<std::size_t>(out->namelen, sizeof(*src)));
+				*src_len = out->namelen;
+			}
+
+			data = name + rx_msg.msg_namelen + rx_msg.msg_controllen;
+			len = out->payloadlen;
+		}
+
+		if (len > cap) {
+			provide(bid);
+			errno = EMSGSIZE;
+			return -1;
+		}
+
+		std::memcpy(dst, data, len);
+		provide(bid);
+
+		/* Multishot receive ended without an error, post it again */
+		if (!armed && submit_receive()) {
+			return -1;
+		}
+
+		return len;
+	}
+}
+
+ssize_t Uring::send(int socket, const char* data, std::size_t len, const struct sockaddr* dst, socklen_t dst_len) {
+	struct iovec iov = {tx_buffer, len};
+	struct msghdr msg = {};
+
+	/* Checked before an entry is taken, a taken one is submitted with the next send */
+	if (len > TX_BUFFER_SIZE) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	struct io_uring_sqe* sqe = tx->get_sqe();
+
+	if (sqe == nullptr) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	std::memcpy(tx_buffer, data, len);
+
+	/* A closed connection is reported by the completion, not by SIGPIPE */
+	if (dst == nullptr) {
+		sqe->opcode = IORING_OP_SEND;
+		sqe->addr = reinterpret_cast<uint64_t>(tx_buffer);
+		sqe->len = len;
+		sqe->msg_flags = MSG_NOSIGNAL;
+	}
+	else {
+		msg.msg_name = const_cast<struct sockaddr*>(dst);
+		msg.msg_namelen = dst_len;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->addr = reinterpret_cast<uint64_t>(&msg);
+		sqe->len = 1;
+	}
+
+	sqe->fd = socket;
+	sqe->user_data = SEND_TAG;
+
+	if (tx->submit(1) < 0) {
+		return -1;
+	}
+
+	struct io_uring_cqe cqe;
+
+	while (!tx->peek(cqe)) {
+		if (tx->submit(1) < 0) {
+			return -1;
+		}
+	}
+
+	if (cqe.res < 0) {
+		errno = -cqe.res;
+		return -1;
+	}
+
+	return cqe.res;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file: uring.hpp
+ *
+ * io_uring I/O backend, raw system calls over <linux/io_uring.h> (no liburing).
+ * Receives are a multishot operation over a ring of provided buffers: the receive ring
+ * descriptor replaces the socket in poll() and a received message costs no further system call.
+ * Sends are staged in a send buffer on a second ring and complete synchronously,
+ * so send errors are reported like with send()/sendto(), MSG_NOSIGNAL included.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+class Uring {
+	public:
+		/* Ring setup and feature check, nullptr when io_uring cannot be used */
+		static std::unique_ptr<Uring> create();
+		~Uring();
+
+		/* Readable when a received message is pending */
+		int get_fd() const;
+
+		/* Post the multishot receive on a socket */
+		int arm(int socket, bool datagram);
+
+		/* Cancel the posted receive, pending messages are dropped */
+		void disarm();
+
+		/* Copy out the next received message, the datagram source is stored when src is set */
+		ssize_t receive(char* dst, std::size_t cap, struct sockaddr_storage* src, socklen_t* src_len);
+
+		/* Send through the send buffer, dst is the datagram destination or nullptr */
+		ssize_t send(int socket, const char* data, std::size_t len, const struct sockaddr* dst, socklen_t dst_len);
+
+	private:
+		/* Mapped submission and completion queues of one ring */
+		struct Ring;
+
+		Uring();
+
+		std::unique_ptr<Ring> rx;
+		std::unique_ptr<Ring> tx;
+
+		/* Provided receive buffers and their ring */
+		struct io_uring_buf_ring* buf_ring;
+		char* rx_buffers;
+
+		/* Send buffer, sends are copied here before they are submitted */
+		char* tx_buffer;
+
+		/* Receive in flight */
+		int socket;
+		bool datagram;
+		bool armed;
+		struct msghdr rx_msg;
+
+		void provide(unsigned short bid);
+		int submit_receive();
+};
@@ -0,0 +1,425 @@
+/**
+ * @file: io_bench.cpp
+ *
+ * I/O backend benchmark, plain system calls against io_uring (--io-uring).
+ * A forked echo server answers every chat message over loopback, the measured process drives
+ * the library's Protocol the way the client loop does: send, wait, receive, process.
+ * Per message it reports the CPU time of the I/O thread and the system calls it made.
+ * System calls are counted under ptrace in a second run, so tracing does not inflate the CPU time.
+ * A second table compares the round trip tail of the latency profiles (--low-latency, --spin)
+ * against the default.
+ * Built with `make ALLOC_STATS=1`, every timed run prints its allocations per message and the exit
+ * code is GENERAL_ERROR when one goes over IPK25_ALLOC_BUDGET.
+ *
+ * Usage: io_bench [-t tcp|udp] [-n messages] [-s spin budget in us]
+ */
+
+#include "../src/alloc_stats.hpp"
+#include "../src/config.hpp"
+#include "../src/error.hpp"
+#include "../src/message.hpp"
+#include "../src/protocol.hpp"
+#include "../src/uring.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct Result {
+	double cpu_us;  // I/O thread CPU time per message
+	double wall_us; // Round trip per message
+	double p50_us;
+	double p99_us;
+	double syscalls;
+	int over_budget; // Allocations per message over IPK25_ALLOC_BUDGET (ALLOC_STATS builds)
+};
+
+/* Echo server, TCP: MSG lines are answered by a MSG of "echo" with the same content */
+void serve_tcp(int listen_fd) {
+	int fd = accept(listen_fd, nullptr, nullptr);
+	std::string in;
+	char chunk[65536];
+	ssize_t bytes;
+
+	while (fd >= 0 && (bytes = read(fd, chunk, sizeof(chunk))) > 0) {
+		in.append(chunk, bytes);
+
+		std::size_t start = 0, end;
+		std::string out;
+
+		while ((end = in.find("\r\n", start)) != std::string::npos) {
+			std::string_view line(in.data() + start, end - start);
+			std::size_t is = line.find(" IS ");
+
+			if (line.substr(0, 9) == "MSG FROM " && is != std::string_view::npos) {
+				out.append("MSG FROM echo IS ").append(line.substr(is + 4)).append("\r\n");
+			}
+
+			start = end + 2;
+		}
+
+		in.erase(0, start);
+
+		if (!out.empty() && write(fd, out.data(), out.size()) < 0) {
+			break;
+		}
+	}
+
+	_exit(0);
+}
+
+/* Echo server, UDP: every message is confirmed, MSG is answered like over TCP */
+void serve_udp(int fd) {
+	char in[65536];
+	uint16_t next_id = 0;
+	struct sockaddr_storage peer;
+	socklen_t peer_len = sizeof(peer);
+	ssize_t bytes;
+
+	while ((bytes = recvfrom(fd, in, sizeof(in), 0, (struct sockaddr *) &peer, &peer_len)) >= 3) {
+		if (static_cast<uint8_t>(in[0]) == CONFIRM) {
+			continue;
+		}
+
+		char confirm[3] = {static_cast<char>(CONFIRM), in[1], in[2]};
+
+		sendto(fd, confirm, sizeof(confirm), 0, (struct sockaddr *) &peer, peer_len);
+
+		if (static_cast<uint8_t>(in[0]) == MSG) {
+			/* <type> <id> <display name>\0 <content>\0 */
+			std::string_view fields(in + 3, bytes - 3);
+			std::string_view content = fields.substr(fields.find('\0') + 1);
+			std::string out = {static_cast<char>(MSG), static_cast<char>(next_id >> 8), static_cast<char>(next_id & 0xFF)};
+
+			out.append("echo", 5).append(content);
+			++next_id;
+
+			sendto(fd, out.data(), out.size(), 0, (struct sockaddr *) &peer, peer_len);
+		}
+
+		peer_len = sizeof(peer);
+	}
+
+	_exit(0);
+}
+
+double thread_cpu_us() {
+	struct rusage usage;
+
+	getrusage(RUSAGE_THREAD, &usage);
+
+	return usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec;
+}
+
+double wall_us() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+/* Wait for the echo of the last sent message, other messages are processed and dropped */
+int await_echo(Protocol& protocol, Response& response) {
+	struct pollfd pfd = {protocol.get_socket(), POLLIN, 0};
+
+	while (true) {
+		/* Received by UDP while the send waited for its CONFIRM */
+		while (protocol.get_msg_queue().pop(response)) {
+			if (response.type == MSG) {
+				return SUCCESS;
+			}
+		}
+
+		bool buffered = protocol.pending();
+
+		if (!buffered && protocol.wait(&pfd, 1, 5000) <= 0) {
+			return TIMEOUT;
+		}
+
+		if ((!buffered && protocol.receive()) || protocol.process(response)) {
+			return NETWORK_ERROR;
+		}
+
+		if (!response.duplicate && !response.incomplete && response.type == MSG) {
+			return SUCCESS;
+		}
+	}
+}
+
+/* Measured process, the result goes to the parent through the pipe */
+void run_client(Config config, int messages, bool traced, int out) {
+	if (traced) {
+		ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+		raise(SIGSTOP);
+	}
+
+	auto protocol = Protocol::protocol_setup(config);
+
+	if (protocol == nullptr) {
+		_exit(1);
+	}
+
+	while (!protocol->is_connected()) {
+		struct pollfd pfd = {protocol->connect_fd(), POLLIN | POLLOUT, 0};
+
+		if (protocol->connect_step()) {
+			_exit(1);
+		}
+
+		if (!protocol->is_connected()) {
+			poll(&pfd, 1, protocol->connect_wait());
+		}
+	}
+
+	std::string msg = protocol->get_msg_factory().create_chat_msg("bench", "The quick brown fox jumps over the lazy dog");
+	Response response;
+	std::vector<double> rtt(messages);
+
+	/* Counting starts and ends at these stops */
+	if (traced) {
+		raise(SIGSTOP);
+	}
+
+	double cpu = thread_cpu_us();
+	double start = wall_us();
+
+	for (int i = 0; i < messages; ++i) {
+		double sent = wall_us();
+		std::string outbound = msg;
+
+		/* The copy is the benchmark's, the accounting window starts after it */
+		alloc_stats::mark();
+
+		if (protocol->send(std::move(outbound)) || await_echo(*protocol, response)) {
+			std::fprintf(stderr, "io_bench: message %d failed\n", i);
+			_exit(1);
+		}
+
+		rtt[i] = wall_us() - sent;
+	}
+
+	Result result = {(thread_cpu_us() - cpu) / messages, (wall_us() - start) / messages, 0, 0, 0, 0};
+
+	std::sort(rtt.begin(), rtt.end());
+	result.p50_us = rtt[messages / 2];
+	result.p99_us = rtt[messages * 99 / 100];
+
+	if (traced) {
+		raise(SIGSTOP);
+	}
+	else {
+#ifdef IPK25_ALLOC_STATS
+		std::fprintf(stderr, "\nio_uring %d, low latency %d, spin %u us\n", config.io_uring, config.low_latency, config.spin_us);
+#endif
+		result.over_budget = alloc_stats::report();
+	}
+
+	if (write(out, &result, sizeof(result)) != sizeof(result)) {
+		_exit(1);
+	}
+
+	_exit(0);
+}
+
+/* System calls of the traced process between its two marker stops */
+long count_syscalls(pid_t pid) {
+	int status;
+	int markers = 0;
+	long stops = 0;
+
+	waitpid(pid, &status, 0);
+	ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+
+	int signal = 0;
+
+	while (ptrace(PTRACE_SYSCALL, pid, nullptr, signal) == 0 && waitpid(pid, &status, 0) == pid && WIFSTOPPED(status)) {
+		signal = 0;
+
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+			stops += markers == 1;
+		}
+		else if (WSTOPSIG(status) == SIGSTOP) {
+			++markers;
+		}
+		else {
+			signal = WSTOPSIG(status);
+		}
+	}
+
+	/* Entry and exit stop per call */
+	return stops / 2;
+}
+
+bool measure(Config config, int messages, bool traced, Result& result) {
+	int type = config.protocol == Config::Protocol::TCP ? SOCK_STREAM : SOCK_DGRAM;
+	int server_fd = socket(AF_INET, type, 0);
+	struct sockaddr_in address = {};
+	socklen_t length = sizeof(address);
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (server_fd < 0 || bind(server_fd, (struct sockaddr *) &address, sizeof(address)) != 0
+		|| (type == SOCK_STREAM && listen(server_fd, 1) != 0)
+		|| getsockname(server_fd, (struct sockaddr *) &address, &length) != 0) {
+		std::perror("io_bench: server socket");
+		return false;
+	}
+
+	pid_t server = fork();
+
+	if (server == 0) {
+		type == SOCK_STREAM ? serve_tcp(server_fd) : serve_udp(server_fd);
+	}
+
+	close(server_fd);
+
+	static char host[] = "127.0.0.1";
+	int pipe_fds[2];
+
+	config.ip_hostname = host;
+	config.server_port = ntohs(address.sin_port);
+
+	if (pipe(pipe_fds) != 0) {
+		return false;
+	}
+
+	pid_t client = fork();
+
+	if (client == 0) {
+		close(pipe_fds[0]);
+		run_client(config, messages, traced, pipe_fds[1]);
+	}
+
+	close(pipe_fds[1]);
+
+	long syscalls = traced ? count_syscalls(client) : 0;
+	bool done = read(pipe_fds[0], &result, sizeof(result)) == sizeof(result);
+	int status;
+
+	close(pipe_fds[0]);
+	waitpid(client, &status, 0);
+	kill(server, SIGKILL);
+	waitpid(server, &status, 0);
+
+	result.syscalls = static_cast<double>(syscalls) / messages;
+
+	return done;
+}
+
+}
+
+int main(int argc, char** argv) {
+	Config config;
+	int messages = 20000;
+	uint32_t spin_us = 50;
+	int opt;
+
+	config.protocol = Config::Protocol::TCP;
+
+	while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+		switch (opt) {
+			case 't':
+				config.protocol = std::strcmp(optarg, "udp") == 0 ? Config::Protocol::UDP : Config::Protocol::TCP;
+				break;
+
+			case 'n':
+				messages = std::atoi(optarg);
+				break;
+
+			case 's':
+				spin_us = std::atoi(optarg);
+				break;
+
+			default:
+				std::fprintf(stderr, "Usage: %s [-t tcp|udp] [-n messages] [-s spin budget in us]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	/* Server message IDs must not wrap around, the client would drop them as duplicates */
+	if (messages <= 0 || (config.protocol == Config::Protocol::UDP && messages > 60000)) {
+		std::fprintf(stderr, "io_bench: 1 to 60000 messages over UDP\n");
+		return 1;
+	}
+
+	bool uring_available = Uring::create() != nullptr;
+	int over_budget = 0;
+
+	std::printf("%s, %d messages, echo round trips over loopback\n\n", config.protocol == Config::Protocol::TCP ? "TCP" : "UDP", messages);
+	std::printf("%-14s %14s %14s %14s\n", "backend", "CPU us/msg", "RTT us/msg", "syscalls/msg");
+
+	for (bool io_uring : {false, true}) {
+		Result timed, traced;
+
+		if (io_uring && !uring_available) {
+			std::printf("%-14s %14s\n", "io_uring", "unavailable");
+			continue;
+		}
+
+		config.io_uring = io_uring;
+
+		if (!measure(config, messages, false, timed) || !measure(config, messages, true, traced)) {
+			std::fprintf(stderr, "io_bench: run failed\n");
+			return 1;
+		}
+
+		std::printf("%-14s %14.2f %14.2f %14.2f\n", io_uring ? "io_uring" : "system calls", timed.cpu_us, timed.wall_us, traced.syscalls);
+		over_budget |= timed.over_budget;
+	}
+
+	/* Latency profiles on plain system calls */
+	config.io_uring = false;
+
+	std::printf("\n%-24s %14s %14s %14s\n", "profile", "RTT p50 us", "RTT p99 us", "CPU us/msg");
+
+	for (int profile = 0; profile < 4; ++profile) {
+		Result timed;
+		std::string name = profile == 0 ? "default" : "";
+
+		config.low_latency = profile & 1;
+		config.spin_us = profile & 2 ? spin_us : 0;
+
+		if (config.low_latency) {
+			name += "--low-latency ";
+		}
+
+		if (config.spin_us) {
+			name += "--spin " + std::to_string(spin_us);
+		}
+
+		if (!measure(config, messages, false, timed)) {
+			std::fprintf(stderr, "io_bench: run failed\n");
+			return 1;
+		}
+
+		std::printf("%-24s %14.2f %14.2f %14.2f\n", name.c_str(), timed.p50_us, timed.p99_us, timed.cpu_us);
+		over_budget |= timed.over_budget;
+	}
+
+	/* Allocation accounting builds fail when a hot path goes over the allocation budget */
+	if (over_budget) {
+		std::fprintf(stderr, "io_bench: over the allocation budget\n");
+		return GENERAL_ERROR;
+	}
+
+	return 0;
+}
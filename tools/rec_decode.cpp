@@ -0,0 +1,96 @@
+/**
+ * @file: rec_decode.cpp
+ *
+ * Flight recorder dump decoder, prints recorded events in chronological order.
+ * Usage: rec_decode <dump file>
+ */
+
+#include "../src/recorder.hpp"
+#include "../src/message.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+const char* event_name(uint8_t event) {
+	switch (static_cast<RecEvent>(event)) {
+		case RecEvent::SEND:       return "SEND";
+		case RecEvent::RECV:       return "RECV";
+		case RecEvent::CONFIRM:    return "CONFIRM";
+		case RecEvent::RETRANSMIT: return "RETRANSMIT";
+		case RecEvent::STATE:      return "STATE";
+		case RecEvent::PARSE_FAIL: return "PARSE_FAIL";
+		default:                   return "?";
+	}
+}
+
+/* Client::State order */
+const char* state_name(unsigned state) {
+	static const char* names[] = {"START", "OPEN", "AWAITING", "END", "ERR"};
+
+	return state < sizeof(names) / sizeof(names[0]) ? names[state] : "?";
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		std::fprintf(stderr, "Usage: %s <dump file>\n", argv[0]);
+		return 1;
+	}
+
+	FILE* file = std::fopen(argv[1], "rb");
+
+	if (file == nullptr) {
+		std::perror(argv[1]);
+		return 1;
+	}
+
+	RecHeader header;
+
+	if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, recorder::MAGIC, sizeof(header.magic)) != 0) {
+		std::fprintf(stderr, "%s: not a flight recorder dump\n", argv[1]);
+		std::fclose(file);
+		return 1;
+	}
+
+	if (header.version != recorder::VERSION || header.capacity == 0) {
+		std::fprintf(stderr, "%s: unsupported dump version %u\n", argv[1], header.version);
+		std::fclose(file);
+		return 1;
+	}
+
+	std::vector<RecRecord> ring(header.capacity);
+
+	if (std::fread(ring.data(), sizeof(RecRecord), ring.size(), file) != ring.size()) {
+		std::fprintf(stderr, "%s: truncated dump\n", argv[1]);
+		std::fclose(file);
+		return 1;
+	}
+
+	std::fclose(file);
+
+	/* Oldest retained event up to the newest one */
+	uint64_t first = header.head > header.capacity ? header.head - header.capacity : 0;
+	uint64_t base = 0;
+
+	std::printf("%llu events recorded, %llu retained\n",
+		static_cast<unsigned long long>(header.head), static_cast<unsigned long long>(header.head - first));
+
+	for (uint64_t i = first; i < header.head; ++i) {
+		const RecRecord& rec = ring[i % header.capacity];
+
+		if (base == 0) {
+			base = rec.timestamp;
+		}
+
+		double ms = static_cast<double>(rec.timestamp - base) / 1e6;
+
+		if (rec.event == static_cast<uint8_t>(RecEvent::STATE)) {
+			std::printf("%12.6f ms  %-10s  %s -> %s\n", ms, event_name(rec.event), state_name(rec.msg_type), state_name(rec.msg_id));
+		}
+		else {
+			std::printf("%12.6f ms  %-10s  %-7s  id=%-5u  size=%u\n", ms, event_name(rec.event), msg_type_name(rec.msg_type), rec.msg_id, rec.size);
+		}
+	}
+
+	return 0;
+}
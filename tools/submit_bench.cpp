@@ -0,0 +1,189 @@
+/**
+ * @file: submit_bench.cpp
+ *
+ * ipk25_submit micro-benchmark. Producer threads submit chat messages to one connected TCP session,
+ * then the main thread drains it through ipk25_poll; a local sink accepts the connection and discards
+ * what it reads. The phases run apart, so the producer cost per submit (validation, serialization
+ * and the queue push) is not mixed with the sends of the polling thread on small machines.
+ * Built with `make ALLOC_STATS=1`, the allocations per message of the drain are printed and the exit
+ * code is GENERAL_ERROR when they go over IPK25_ALLOC_BUDGET.
+ * Usage: submit_bench [-t threads] [-n messages per thread]
+ */
+
+#include "../src/alloc_stats.hpp"
+#include "../src/error.hpp"
+#include "../src/ipk25.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+/* Accepts one connection and reads until it closes */
+void sink(int listen_fd) {
+	int fd = accept(listen_fd, nullptr, nullptr);
+	char chunk[65536];
+
+	while (fd >= 0 && read(fd, chunk, sizeof(chunk)) > 0) {}
+
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+void on_event(void* user, const ipk25_event* event) {
+	if (event->type == IPK25_EVENT_CONNECTED) {
+		static_cast<std::atomic<bool>*>(user)->store(true);
+	}
+}
+
+/* One round of the caller's event loop */
+int poll_once(ipk25_session* session, int timeout) {
+	struct pollfd pfds[2] = {{ipk25_fd(session), POLLIN, 0}, {ipk25_submit_fd(session), POLLIN, 0}};
+	int due = ipk25_timeout(session);
+
+	poll(pfds, 2, due >= 0 && due < timeout ? due : timeout);
+
+	return ipk25_poll(session);
+}
+
+int main(int argc, char** argv) {
+	int threads = 4;
+	int messages = 100000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+		switch (opt) {
+			case 't':
+				threads = std::atoi(optarg);
+				break;
+
+			case 'n':
+				messages = std::atoi(optarg);
+				break;
+
+			default:
+				std::fprintf(stderr, "Usage: %s [-t threads] [-n messages per thread]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if (threads <= 0 || messages <= 0) {
+		std::fprintf(stderr, "Usage: %s [-t threads] [-n messages per thread]\n", argv[0]);
+		return 1;
+	}
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address = {};
+	socklen_t length = sizeof(address);
+
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listen_fd, 1) != 0
+		|| getsockname(listen_fd, (struct sockaddr *) &address, &length) != 0) {
+		std::perror("submit_bench: sink socket");
+		return 1;
+	}
+
+	std::thread sink_thread(sink, listen_fd);
+	std::atomic<bool> connected{false};
+	ipk25_options options = {};
+
+	options.transport = IPK25_TCP;
+	options.host = "127.0.0.1";
+	options.port = ntohs(address.sin_port);
+
+	ipk25_session* session = ipk25_open(&options, on_event, &connected);
+
+	while (session != nullptr && !connected) {
+		if (poll_once(session, 100)) {
+			ipk25_close(session);
+			session = nullptr;
+		}
+	}
+
+	if (session == nullptr) {
+		std::fprintf(stderr, "submit_bench: session setup failed\n");
+		shutdown(listen_fd, SHUT_RDWR);
+		sink_thread.join();
+		return 1;
+	}
+
+	std::vector<std::thread> producers;
+	std::vector<double> submit_ns(threads);
+
+	for (int t = 0; t < threads; ++t) {
+		producers.emplace_back([&, t] {
+			char content[64];
+			Clock::duration spent{0};
+
+			for (int i = 0; i < messages; ++i) {
+				std::snprintf(content, sizeof(content), "Message %d of producer %d", i, t);
+
+				Clock::time_point before = Clock::now();
+
+				ipk25_submit(session, "bench", content);
+				spent += Clock::now() - before;
+			}
+
+			submit_ns[t] = std::chrono::duration<double, std::nano>(spent).count() / messages;
+		});
+	}
+
+	for (std::thread& producer : producers) {
+		producer.join();
+	}
+
+	/* Everything submitted is sent in order by the polling thread, accounted apart from the producers */
+	alloc_stats::mark();
+
+	Clock::time_point start = Clock::now();
+	int result = 0;
+
+	while (result == 0 && ipk25_timeout(session) == 0) {
+		result = poll_once(session, 10);
+	}
+
+	Clock::time_point drained = Clock::now();
+	int over_budget = alloc_stats::report();
+
+	ipk25_close(session);
+	sink_thread.join();
+	close(listen_fd);
+
+	if (result != 0) {
+		std::fprintf(stderr, "submit_bench: ipk25_poll failed with %d\n", result);
+		return 1;
+	}
+
+	double total = static_cast<double>(threads) * messages;
+	double elapsed = std::chrono::duration<double>(drained - start).count();
+	double average = 0;
+
+	for (double ns : submit_ns) {
+		average += ns / threads;
+	}
+
+	std::printf("%d producers x %d messages, %u CPUs\n", threads, messages, std::thread::hardware_concurrency());
+	std::printf("submit:  %.0f ns per call (producer side)\n", average);
+	std::printf("drain:   %.0f ns per message sent by ipk25_poll (%.0f messages/s)\n", elapsed * 1e9 / total, total / elapsed);
+
+	/* Allocation accounting builds fail when the drain goes over the allocation budget */
+	if (over_budget) {
+		std::fprintf(stderr, "submit_bench: over the allocation budget\n");
+		return GENERAL_ERROR;
+	}
+
+	return 0;
+}